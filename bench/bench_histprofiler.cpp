@@ -0,0 +1,259 @@
+/*
+	cost of the recording path, cycles and nanos per operation.
+	every case runs on 1, 2, 4 ... --threads threads, each thread with its own metric like thread_local ones,
+	and is measured in batches of operations, timed as a whole: the results are the median and p99
+	of the batch averages (batchAvg...), a single slow operation is spread over its batch.
+
+	bench_histprofiler [--threads N] [--quick] [--out bench_histprofiler.json]
+
+	shmFile prints to stdout when it creates a file, the results go to the json file only
+*/
+#include "profilerApi.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+namespace
+{
+
+struct options
+{
+	size_t _maxThreads{std::max<size_t>(std::thread::hardware_concurrency(), 1)};
+	size_t _batches{200};
+	size_t _opsPerBatch{1000};
+	std::string _out{"bench_histprofiler.json"};
+};
+
+struct result
+{
+	std::string _name;
+	std::string _clock;
+	size_t _buckets{0};
+	size_t _threads{0};
+	size_t _batches{0};
+	size_t _opsPerBatch{0};
+	double _batchAvgMedianCycles{0};
+	double _batchAvgP99Cycles{0};
+};
+
+uint64_t cycles()
+{
+#if defined(HIST_PROFILER_HAS_TSC)
+	return __rdtsc();
+#else
+	return static_cast<uint64_t>(profiler::latencyToken::monotonicNanos());
+#endif
+}
+
+// a benchmark case makes the per thread state and returns the operation to measure
+using operation_t = std::function<void()>;
+using makeOperation_t = std::function<operation_t(size_t threadIndex)>;
+
+result run(const std::string& name, const std::string& clock, size_t buckets, size_t threads,
+		   size_t batches, size_t opsPerBatch, const makeOperation_t& makeOperation)
+{
+	std::vector<std::vector<double>> perThread(threads);
+	std::atomic<size_t> ready{0};
+
+	auto worker = [&](size_t index){
+		auto op{makeOperation(index)};
+		auto& costs{perThread[index]};
+		costs.reserve(batches);
+
+		// all the threads record at the same time
+		++ready;
+		while (ready.load() != threads)
+			std::this_thread::yield();
+
+		for (size_t b = 0; b < batches; ++b)
+		{
+			const auto begin{cycles()};
+			for (size_t i = 0; i < opsPerBatch; ++i)
+				op();
+			costs.push_back(static_cast<double>(cycles() - begin) / opsPerBatch);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t)
+		workers.emplace_back(worker, t);
+	for (auto& w : workers)
+		w.join();
+
+	std::vector<double> all;
+	for (const auto& costs : perThread)
+		all.insert(all.end(), costs.begin(), costs.end());
+	std::sort(all.begin(), all.end());
+
+	result res{name, clock, buckets, threads, batches, opsPerBatch};
+	res._batchAvgMedianCycles = all[all.size() / 2];
+	res._batchAvgP99Cycles = all[std::min(all.size() - 1, all.size() * 99 / 100)];
+	return res;
+}
+
+std::string instanceName(const std::string& name, size_t buckets)
+{
+	return "bench_" + name + "_" + std::to_string(buckets);
+}
+
+void writeJson(std::ostream& out, const std::vector<result>& results)
+{
+	const auto& calibration{profiler::tscCalibration::instance()};
+	out << "{" << std::endl
+		<< "\t\"tsc\": {\"invariant\": " << (calibration._invariant ? "true" : "false")
+		<< ", \"nanosPerTick\": " << calibration._nanosPerTick << "}," << std::endl
+		<< "\t\"benchmarks\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const auto& r{results[i]};
+		out << "\t\t{\"name\": \"" << r._name << "\", \"clock\": \"" << r._clock << "\", \"buckets\": " << r._buckets
+			<< ", \"threads\": " << r._threads << ", \"batches\": " << r._batches << ", \"opsPerBatch\": " << r._opsPerBatch
+			<< ", \"batchAvgMedianCycles\": " << r._batchAvgMedianCycles << ", \"batchAvgP99Cycles\": " << r._batchAvgP99Cycles
+			<< ", \"batchAvgMedianNanos\": " << r._batchAvgMedianCycles * calibration._nanosPerTick
+			<< ", \"batchAvgP99Nanos\": " << r._batchAvgP99Cycles * calibration._nanosPerTick << "}"
+			<< (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	out << "\t]" << std::endl << "}" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	options opts;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			opts._maxThreads = std::max<size_t>(std::stoul(argv[++i]), 1);
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			opts._out = argv[++i];
+		else if (strcmp(argv[i], "--quick") == 0)
+		{
+			opts._batches = 20;
+			opts._opsPerBatch = 100;
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--threads N] [--quick] [--out file.json]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<size_t> threadCounts;
+	for (size_t t = 1; t < opts._maxThreads; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(opts._maxThreads);
+
+	std::vector<result> results;
+	const auto batches{opts._batches};
+	const auto ops{opts._opsPerBatch};
+
+	for (const auto threads : threadCounts)
+	{
+		for (const size_t buckets : {16, 1024, 65536})
+		{
+			results.push_back(run("histogram.sample", "none", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::histogram>(buckets, instanceName("hist", buckets), index + 1, "", "bench")};
+				return [hist, buckets, i = uint64_t{0}]() mutable { hist->sample(i++ % buckets); };
+			}));
+		}
+
+		for (const size_t buckets : {100, 10000})
+		{
+			results.push_back(run("timeHistogram.beginEnd", "system_clock", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::timeHistogram>(1, buckets, instanceName("timeHist", buckets), index + 1, "bench")};
+				return [hist](){ hist->begin(); hist->end(); };
+			}));
+			results.push_back(run("timeHistogram.consume", "tsc", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::timeHistogram>(1, buckets, instanceName("latencyHist", buckets), index + 1, "bench")};
+				return [hist](){ hist->consume(profiler::latencyToken::now()); };
+			}));
+			results.push_back(run("timeHistogram.sampled", "system_clock", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::timeHistogram>(1, buckets, instanceName("sampledHist", buckets), index + 1, "bench", 0, 0, 100)};
+				return [hist](){ hist->begin(); hist->end(); };
+			}));
+			// beginEnd plus the write to the thread's event ring
+			profiler::eventRing::configure(4096);
+			results.push_back(run("timeHistogram.eventRing", "system_clock", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::timeHistogram>(1, buckets, instanceName("eventRingHist", buckets), index + 1, "bench")};
+				return [hist](){ hist->begin(); hist->end(); };
+			}));
+			profiler::eventRing::configure(0);
+			// the same regions with the relative error sketch, buckets is its max number of buckets
+			results.push_back(run("timeSketch.beginEnd", "system_clock", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto sketch{std::make_shared<profiler::timeSketch>(0.01, buckets, instanceName("timeSketch", buckets), index + 1, "bench")};
+				return [sketch](){ sketch->begin(); sketch->end(); };
+			}));
+			// the recording path alone, latency like values from 1 micro to 10 millis
+			results.push_back(run("timeHistogram.sample", "none", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::timeHistogram>(1000, buckets, instanceName("sampleHist", buckets), index + 1, "bench")};
+				return [hist, i = uint64_t{0}]() mutable { hist->sample(1000 + (i++ * 7919) % 10'000'000); };
+			}));
+			results.push_back(run("timeSketch.sample", "none", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto sketch{std::make_shared<profiler::timeSketch>(0.01, buckets, instanceName("sampleSketch", buckets), index + 1, "bench")};
+				return [sketch, i = uint64_t{0}]() mutable { sketch->sample(1000 + (i++ * 7919) % 10'000'000); };
+			}));
+			results.push_back(run("cpuTimeHistogram.beginEnd", "tsc+thread_cputime", buckets, threads, batches, ops, [buckets](size_t index) -> operation_t {
+				auto hist{std::make_shared<profiler::cpuTimeHistogram>(1, buckets, instanceName("cpuTimeHist", buckets), index + 1, "bench")};
+				return [hist](){ hist->begin(); hist->end(); };
+			}));
+		}
+
+		results.push_back(run("rateCounter.sample", "steady_clock", 100, threads, batches, ops, [](size_t index) -> operation_t {
+			auto rate{std::make_shared<profiler::rateCounter>(1'000'000, 100, instanceName("rate", 100), index + 1, "bench")};
+			return [rate](){ rate->sample(1); };
+		}));
+		results.push_back(run("gauge.set", "none", 0, threads, batches, ops, [](size_t index) -> operation_t {
+			auto value{std::make_shared<profiler::gauge>(false, instanceName("gauge", 0), index + 1, "bench")};
+			return [value, i = int64_t{0}]() mutable { value->set(i++ % 100); };
+		}));
+		results.push_back(run("gauge.setTimeWeighted", "steady_clock", 0, threads, batches, ops, [](size_t index) -> operation_t {
+			auto value{std::make_shared<profiler::gauge>(true, instanceName("weightedGauge", 0), index + 1, "bench")};
+			return [value, i = int64_t{0}]() mutable { value->set(i++ % 100); };
+		}));
+		results.push_back(run("counter.add", "none", 0, threads, batches, ops, [](size_t index) -> operation_t {
+			auto count{std::make_shared<profiler::counter>(instanceName("counter", 0), index + 1, "bench")};
+			return [count](){ count->add(1); };
+		}));
+		results.push_back(run("valueHistogram.sample", "none", 0, threads, batches, ops, [](size_t index) -> operation_t {
+			auto hist{std::make_shared<profiler::valueHistogram>(profiler::symmetricLogLinearValues(1e-6, 3, 20),
+				instanceName("valueHist", 0), index + 1, "seconds", "bench")};
+			return [hist, i = int64_t{0}]() mutable { hist->sample(static_cast<double>(i++ % 2001 - 1000) * 1e-5); };
+		}));
+		// 16 values per operation, the cost of one sample is the time / 16
+		results.push_back(run("valueHistogram.sampleBatch16", "none", 0, threads, batches, ops, [](size_t index) -> operation_t {
+			auto hist{std::make_shared<profiler::valueHistogram>(profiler::symmetricLogLinearValues(1e-6, 3, 20),
+				instanceName("valueHistBatch", 0), index + 1, "seconds", "bench")};
+			auto values{std::make_shared<std::vector<double>>(16)};
+			for (size_t i = 0; i < values->size(); ++i)
+				(*values)[i] = (static_cast<double>(i) - 8) * 1e-3;
+			return [hist, values](){ hist->sampleBatch(values->data(), values->size()); };
+		}));
+
+		// creating a file per thread is what thread churn costs
+		results.push_back(run("shmFile.construct", "none", 1024, threads, std::max<size_t>(batches / 10, 2), std::max<size_t>(ops / 100, 1),
+			[](size_t index) -> operation_t {
+				return [name = instanceName("shmFile", index + 1) + ".shm"](){
+					profiler::shmFile<profiler::shmHistHeader, uint64_t> file{name, profiler::shmHistHeader{1024}, 1024};
+				};
+			}));
+	}
+
+	std::ofstream out{opts._out};
+	writeJson(out, results);
+	if (!out)
+	{
+		std::cerr << "failed to write " << opts._out << std::endl;
+		return 1;
+	}
+	std::cerr << "wrote " << results.size() << " results to " << opts._out << std::endl;
+	return 0;
+}
@@ -0,0 +1,50 @@
+#include "histProfiler/alerts.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/*
+	sidecar that evaluates threshold rules against the shm files of a running process
+	and dumps all of them when a rule fires
+
+	histAlert <rules file> <dump dir> [<window millis, default 1000>] [<shm dir, default .>]
+
+	see histProfiler/alerts.h for the rules
+*/
+
+int usage(const std::string& desc)
+{
+	std::cout << desc << std::endl
+		<< "histAlert <rules file> <dump dir> [<window millis>] [<shm dir>]" << std::endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+		return usage("Usage");
+
+	const std::chrono::milliseconds window{argc > 3 ? std::stoull(argv[3]) : 1000};
+	profiler::alertEngine engine{argc > 4 ? argv[4] : ".", argv[2]};
+	for (auto& rule : profiler::loadAlertRules(argv[1]))
+	{
+		std::cout << rule << std::endl;
+		engine.add(std::move(rule));
+	}
+	if (engine.numRules() == 0)
+		return usage(std::string{"no rules in "} + argv[1]);
+
+	auto next{std::chrono::steady_clock::now()};
+	for (;;)
+	{
+		next += window;
+		std::this_thread::sleep_until(next);
+		const auto now{std::chrono::steady_clock::now()};
+		const auto nowNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count()};
+		for (const auto& alert : engine.evaluate(static_cast<uint64_t>(nowNanos)))
+			std::cout << "fired " << *alert._rule << ", value: " << alert._value << ", dump: " << alert._dump << std::endl;
+	}
+	return 0;
+}
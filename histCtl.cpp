@@ -0,0 +1,95 @@
+#include "histProfiler/control.h"
+#include "histProfiler/utils.h"
+
+#include <iostream>
+#include <string>
+#include <string.h>
+
+/*
+	operator tool for the control page of a running process
+
+	histCtl shmFile_control_<pid>.shm list
+	histCtl shmFile_control_<pid>.shm enable <id>
+	histCtl shmFile_control_<pid>.shm disable <id>
+	histCtl shmFile_control_<pid>.shm ratio <id> <1 in N, 0 - as configured>
+	histCtl shmFile_control_<pid>.shm resolution <id> <nanos per bucket, 0 - as configured>
+
+	<id> is the id given to the ThreadLocal* macro, all call sites with this id are changed
+*/
+
+int usage(const std::string& desc)
+{
+	std::cout << desc << std::endl
+		<< "histCtl <control file> list" << std::endl
+		<< "histCtl <control file> enable|disable <id>" << std::endl
+		<< "histCtl <control file> ratio <id> <N>" << std::endl
+		<< "histCtl <control file> resolution <id> <nanos per bucket>" << std::endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+		return usage("Usage");
+
+	profiler::shmFile<profiler::shmControlHeader, profiler::controlEntry> control{argv[1]};
+	const auto& header{control.header()};
+	if (header._magic != profiler::shmControlHeader::magic())
+		return usage(std::string{argv[1]} + " is not a control page");
+
+	const std::string cmd{argv[2]};
+	const auto numEntries{std::min<uint64_t>(header._numEntries, control.endData() - control.data())};
+
+	if (cmd == "list")
+	{
+		std::cout << header << std::endl;
+		for (uint64_t i = 0; i < numEntries; ++i)
+			std::cout << control.data()[i] << std::endl;
+		return 0;
+	}
+
+	if (argc < 4)
+		return usage("missing id for " + cmd);
+	const std::string id{argv[3]};
+
+	uint64_t value{0};
+	if (cmd == "ratio" || cmd == "resolution")
+	{
+		if (argc < 5)
+			return usage("missing value for " + cmd);
+		value = std::stoull(argv[4]);
+	}
+	else if (cmd != "enable" && cmd != "disable")
+	{
+		return usage("unexpected command " + cmd);
+	}
+
+	size_t changed{0};
+	for (uint64_t i = 0; i < numEntries; ++i)
+	{
+		auto& entry{control.data()[i]};
+		if (id != entry._id)
+			continue;
+
+		auto enable{profiler::controlEntry::enabled(entry.state())};
+		if (cmd == "enable")
+			enable = true;
+		else if (cmd == "disable")
+			enable = false;
+		else if (cmd == "ratio")
+			entry._samplingRatio = value;
+		else
+			entry._samplesPerBucket = value;
+
+		entry.update(enable);
+		std::cout << entry << std::endl;
+		++changed;
+	}
+
+	if (changed == 0)
+	{
+		std::cerr << "no call site with id " << id << std::endl;
+		return 1;
+	}
+	return 0;
+}
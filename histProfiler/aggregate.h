@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "histogram.h"
+#include "registry.h"
+
+namespace profiler
+{
+
+// a count of sampled regions as an estimate of all the calls
+inline uint64_t scaled(uint64_t count, double scale)
+{
+	return scale == 1 ? count : static_cast<uint64_t>(std::llround(static_cast<double>(count) * scale));
+}
+
+// an aggregate starts empty with the configuration of its first thread
+inline shmHistHeader aggregateHeader(const shmHistHeader& from)
+{
+	auto header{from};
+	header._maxSample = header._overfows = header._sum = header._numSamples = 0;
+	header._minSample = std::numeric_limits<uint64_t>::max();
+	header._exemplars.clear();
+	return header;
+}
+
+/*
+	threads sample at different ratios, an adaptive one changes its ratio every second,
+	so the aggregate holds every thread's counts scaled by its _numCalls / _numSamples and is not sampled itself.
+	the overhead is calibrated once per process, the same in every thread
+*/
+inline shmTimeHistHeader aggregateHeader(const shmTimeHistHeader& from)
+{
+	auto header{from};
+	header.resetSamples();
+	header._samplingRatio = 1;
+	header._samplingBudgetNanos = header._samplingCostNanos = 0;
+	return header;
+}
+
+inline double sampledScale(const shmHistHeader&)
+{
+	return 1;
+}
+
+inline double sampledScale(const shmTimeHistHeader& header)
+{
+	// a reader may have zeroed _numCalls
+	if (header._numSamples == 0 || header._numCalls <= header._numSamples)
+		return 1;
+	return static_cast<double>(header._numCalls) / static_cast<double>(header._numSamples);
+}
+
+// adds the stats of a thread's header to the aggregate, false when the buckets don't line up
+inline bool foldHeader(shmHistHeader& to, const shmHistHeader& from)
+{
+	if (to._numBuckets != from._numBuckets)
+		return false;
+	to._maxSample = std::max(to._maxSample, from._maxSample);
+	to._minSample = std::min(to._minSample, from._minSample);
+	to._overfows += from._overfows;
+	to._sum += from._sum;
+	to._numSamples += from._numSamples;
+	to._exemplars.merge(from._exemplars);
+	return true;
+}
+
+inline bool foldHeader(shmTimeHistHeader& to, const shmTimeHistHeader& from)
+{
+	if (to._numBuckets != from._numBuckets || to._samplesPerBucket != from._samplesPerBucket
+		|| to._expectedIntervalNanos != from._expectedIntervalNanos)
+		return false;
+	const auto scale{sampledScale(from)};
+	to._maxSample = std::max(to._maxSample, from._maxSample);
+	to._minSample = std::min(to._minSample, from._minSample);
+	to._overfows += scaled(from._overfows, scale);
+	to._sum += scaled(from._sum, scale);
+	to._numSamples += scaled(from._numSamples, scale);
+	to._correctedOverflows += scaled(from._correctedOverflows, scale);
+	to._correctedSum += scaled(from._correctedSum, scale);
+	to._correctedNumSamples += scaled(from._correctedNumSamples, scale);
+	to._numCalls += std::max(from._numCalls, from._numSamples);
+	to._clockSkews += from._clockSkews;
+	to._maxClockSkewNanos = std::max(to._maxClockSkewNanos, from._maxClockSkewNanos);
+	to._exemplars.merge(from._exemplars);
+	return true;
+}
+
+/*
+	process wide total of the threads of an id that exited: shmFile_<id>_0.shm, instances start from 1.
+	a thread folds its buckets and stats into it when it exits and gives its instance number back once its file is unmapped,
+	the next thread of the id takes the number and so the file, the number of files is bounded
+	by the number of threads alive at once plus the aggregate.
+	folds are serialized by the mutex, they happen once per thread
+*/
+template <typename metric_t>
+class processAggregate final
+{
+public:
+	using header_t = std::remove_reference_t<decltype(std::declval<metric_t&>()._shmHist.header())>;
+
+	// one per id, never destroyed: threads may exit after the statics are gone
+	static processAggregate& of(const metricSite& site)
+	{
+		static std::mutex mtx;
+		static auto* aggregates{new std::map<std::string, std::unique_ptr<processAggregate>>{}};
+
+		std::lock_guard<std::mutex> l{mtx};
+		auto& aggregate{(*aggregates)[site._id]};
+		if (!aggregate)
+			aggregate.reset(new processAggregate{site._id});
+		return *aggregate;
+	}
+
+	// a number of an exited thread or a new one
+	metricInstance acquire(metricSite& site)
+	{
+		{
+			std::lock_guard<std::mutex> l{_mtx};
+			if (!_free.empty())
+			{
+				const auto number{_free.back()};
+				_free.pop_back();
+				return {number, *site._control};
+			}
+		}
+		return site.nextInstance();
+	}
+
+	void fold(const metric_t& metric)
+	{
+		const auto& from{metric._shmHist};
+		const auto dataSize{static_cast<size_t>(from.endData() - from.data())};
+
+		std::lock_guard<std::mutex> l{_mtx};
+		if (!_total || !foldHeader(_total->header(), from.header()))
+		{
+			// the first thread, or the configuration changed - start over from this thread
+			_total.reset();
+			_total = std::make_unique<shmFile<header_t, uint64_t>>("shmFile_" + _id + "_0.shm", aggregateHeader(from.header()), dataSize);
+			foldHeader(_total->header(), from.header());
+		}
+		const auto scale{sampledScale(from.header())};
+		auto* to{_total->data()};
+		const auto size{std::min(dataSize, static_cast<size_t>(_total->endData() - to))};
+		for (size_t i = 0; i < size; ++i)
+			to[i] += scaled(from.data()[i], scale);
+		++_foldedThreads;
+	}
+
+	// the file of the number is unmapped, a new thread may open it with O_TRUNC
+	void recycle(size_t number)
+	{
+		std::lock_guard<std::mutex> l{_mtx};
+		_free.push_back(number);
+	}
+
+	const shmFile<header_t, uint64_t>* total() const { return _total.get(); }
+	size_t foldedThreads() const { return _foldedThreads; }
+
+private:
+	explicit processAggregate(std::string id)
+	: _id{std::move(id)}
+	{}
+
+	std::string _id;
+	std::mutex _mtx;
+	std::vector<size_t> _free;
+	std::unique_ptr<shmFile<header_t, uint64_t>> _total;
+	size_t _foldedThreads{0};
+};
+
+// stands for the instance argument of the metric constructor, see foldOnExit
+struct pooledInstance final {};
+inline constexpr pooledInstance pooled{};
+
+template <typename metric_t>
+struct foldOnExitBase
+{
+	explicit foldOnExitBase(metricSite& site)
+	: _aggregate{processAggregate<metric_t>::of(site)}
+	, _instance{_aggregate.acquire(site)}
+	{}
+
+	// after ~metric_t, the metric's file is unmapped by now
+	~foldOnExitBase()
+	{
+		_aggregate.recycle(_instance._number);
+	}
+
+	processAggregate<metric_t>& _aggregate;
+	metricInstance _instance;
+};
+
+/*
+	a thread_local metric that folds itself into processAggregate when its thread exits.
+	the arguments are those of the metric with profiler::pooled instead of the instance:
+	foldOnExit<timeHistogram> hist{site, 1000, 100, "id", profiler::pooled, "description"};
+*/
+template <typename metric_t>
+struct foldOnExit final : foldOnExitBase<metric_t>, metric_t
+{
+	template <typename ... args_t>
+	foldOnExit(metricSite& site, args_t&& ... args)
+	: foldOnExitBase<metric_t>{site}
+	, metric_t(instanceOr(std::forward<args_t>(args))...)
+	{}
+	foldOnExit(const foldOnExit&) = delete;
+	foldOnExit& operator=(const foldOnExit&) = delete;
+
+	~foldOnExit()
+	{
+		this->_aggregate.fold(*this);
+	}
+
+private:
+	template <typename arg_t>
+	decltype(auto) instanceOr(arg_t&& arg)
+	{
+		if constexpr (std::is_same_v<std::decay_t<arg_t>, pooledInstance>)
+			return metricInstance{this->_instance};
+		else
+			return std::forward<arg_t>(arg);
+	}
+};
+
+}
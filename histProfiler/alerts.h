@@ -0,0 +1,411 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "histogram.h"
+#include "shmFile.h"
+
+namespace profiler
+{
+
+/*
+	threshold rules on the histograms of a process, evaluated by a sidecar (histAlert) or in process.
+	a rule is a line: <name> <shm file> <signal> <threshold> [<consecutive windows>]
+		tailLatency shmFile_tasks_1.shm p99 2000000 3 - p99 of the window above 2 millis for 3 windows
+		overflowing shmFile_tasks_1.shm overflows 100 - more than 100 overflows per second
+		busy shmFile_sizes_1.shm samples 1000000 - more than a million samples per second
+	signals are computed on what was recorded since the previous window, not on the totals
+*/
+enum class alertSignal : uint64_t
+{
+	percentile,
+	overflowRate,
+	sampleRate,
+};
+
+struct alertRule
+{
+	std::string _name;
+	std::filesystem::path _file;
+	alertSignal _signal{alertSignal::percentile};
+	double _percentile{99}; // of percentile rules
+	uint64_t _threshold{0}; // units of the histogram for percentiles, per second for the rates
+	uint64_t _windows{1}; // consecutive windows above the threshold to fire
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const alertRule& obj)
+{
+	stream << obj._name << ": " << obj._file.string() << ' ';
+	if (obj._signal == alertSignal::percentile)
+		stream << 'p' << obj._percentile;
+	else
+		stream << (obj._signal == alertSignal::overflowRate ? "overflows" : "samples");
+	stream << " > " << obj._threshold << " for " << obj._windows << " windows";
+	return stream;
+}
+
+inline alertRule parseAlertRule(const std::string& line)
+{
+	std::istringstream strm{line};
+	alertRule rule;
+	std::string file, signal;
+	if (!(strm >> rule._name >> file >> signal >> rule._threshold))
+		Throw(std::runtime_error) << "expected <name> <shm file> <signal> <threshold> [<windows>]: " << line << End;
+	rule._file = file;
+	if (!(strm >> rule._windows))
+		rule._windows = 1;
+	rule._windows = std::max<uint64_t>(rule._windows, 1);
+
+	if (signal == "overflows")
+	{
+		rule._signal = alertSignal::overflowRate;
+	}
+	else if (signal == "samples")
+	{
+		rule._signal = alertSignal::sampleRate;
+	}
+	else if (signal.size() > 1 && signal[0] == 'p')
+	{
+		rule._signal = alertSignal::percentile;
+		rule._percentile = std::stod(signal.substr(1));
+		if (rule._percentile <= 0 || rule._percentile >= 100)
+			Throw(std::runtime_error) << "percentile out of (0, 100): " << line << End;
+	}
+	else
+	{
+		Throw(std::runtime_error) << "unexpected signal " << signal << ": " << line << End;
+	}
+	return rule;
+}
+
+// rules of a file, one per line, # starts a comment
+inline std::vector<alertRule> loadAlertRules(const std::filesystem::path& path)
+{
+	std::ifstream strm{path};
+	if (!strm)
+		Throw(std::runtime_error) << "FAILED to open " << path << End;
+
+	std::vector<alertRule> rules;
+	std::string line;
+	while (std::getline(strm, line))
+	{
+		line = line.substr(0, line.find('#'));
+		if (line.find_first_not_of(" \t\r") != std::string::npos)
+			rules.push_back(parseAlertRule(line));
+	}
+	return rules;
+}
+
+struct firedAlert
+{
+	const alertRule* _rule{nullptr};
+	uint64_t _value{0}; // of the window that fired
+	std::filesystem::path _dump; // empty if the dump failed
+};
+
+/*
+	evaluates the rules once per window. rules are grouped by file and a file is read once per window:
+	when its _numSamples didn't move, the rules of the file see an empty window without touching the buckets,
+	otherwise the buckets are diffed against the previous window into tail sums, once for all the rules of the file,
+	and a percentile is a binary search on them. the cost is the buckets of the files that changed, a rule is O(log buckets).
+	a rule fires once when it stays above its threshold for _windows windows and rearms when it drops below.
+	on fire every shmFile_*.shm of the directory is copied to <dump dir>/alert_<time>_<rule>,
+	the directory is renamed into place once complete so a reader never sees a partial dump
+*/
+class alertEngine final
+{
+public:
+	alertEngine(std::filesystem::path shmDir, std::filesystem::path dumpDir)
+	: _shmDir{std::move(shmDir)}, _dumpDir{std::move(dumpDir)}
+	{}
+
+	void add(alertRule rule)
+	{
+		auto& watched{_watched[rule._file]};
+		watched._rules.push_back(_rules.size());
+		_rules.push_back({std::move(rule)});
+	}
+
+	// nowNanos - steady clock, the rates are per second of the time between the calls
+	std::vector<firedAlert> evaluate(uint64_t nowNanos)
+	{
+		std::vector<firedAlert> fired;
+		const auto elapsedNanos{_lastNanos > 0 && nowNanos > _lastNanos ? nowNanos - _lastNanos : 0};
+		_lastNanos = nowNanos;
+
+		for (auto& [file, watched] : _watched)
+		{
+			// a file that can't be read is an empty window for its rules, the others go on
+			bool changed{false};
+			try
+			{
+				changed = window(file, watched);
+				watched._error.clear();
+			}
+			catch (const std::exception& e)
+			{
+				if (watched._error != e.what())
+					std::cerr << "FAILED to read " << file << ": " << e.what() << std::endl;
+				watched._error = e.what();
+			}
+			for (const auto index : watched._rules)
+			{
+				auto& state{_rules[index]};
+				const auto value{changed ? signal(state, watched, elapsedNanos) : 0};
+				if (value <= state._rule._threshold)
+				{
+					state._above = 0;
+					state._fired = false;
+					continue;
+				}
+				if (++state._above < state._rule._windows || state._fired)
+					continue;
+				state._fired = true;
+				fired.push_back({&state._rule, value, dump(state._rule, value)});
+			}
+		}
+		return fired;
+	}
+
+	// copies the shm files, the directory shows up complete or not at all
+	std::filesystem::path dump(const alertRule& rule, uint64_t value) const
+	{
+		const auto now{std::chrono::system_clock::now()};
+		const auto secs{std::chrono::system_clock::to_time_t(now)};
+		const auto nanos{std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count() % 1'000'000'000};
+		std::tm tm{};
+		::localtime_r(&secs, &tm);
+		char stamp[32] = {'\0'};
+		const auto len{std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm)};
+		snprintf(stamp + len, sizeof(stamp) - len, ".%09lld", static_cast<long long>(nanos));
+		const auto name{"alert_" + std::string{stamp} + "_" + rule._name};
+
+		std::error_code ec;
+		const auto tmp{_dumpDir / ("." + name)};
+		std::filesystem::create_directories(tmp, ec);
+		if (ec)
+		{
+			std::cerr << "FAILED to create " << tmp << ": " << ec.message() << std::endl;
+			return {};
+		}
+		for (const auto& entry : std::filesystem::directory_iterator{_shmDir, ec})
+		{
+			const auto filename{entry.path().filename().string()};
+			if (!entry.is_regular_file() || filename.rfind("shmFile_", 0) != 0 || entry.path().extension() != ".shm")
+				continue;
+			std::filesystem::copy_file(entry.path(), tmp / filename, ec);
+			if (ec)
+				std::cerr << "FAILED to copy " << entry.path() << ": " << ec.message() << std::endl;
+		}
+		{
+			std::ofstream reason{tmp / "alert.txt"};
+			reason << rule << std::endl << "value: " << value << std::endl;
+		}
+
+		const auto path{_dumpDir / name};
+		std::filesystem::rename(tmp, path, ec);
+		if (ec)
+		{
+			std::cerr << "FAILED to rename " << tmp << ": " << ec.message() << std::endl;
+			return {};
+		}
+		return path;
+	}
+
+	size_t numRules() const { return _rules.size(); }
+
+private:
+	struct ruleState
+	{
+		alertRule _rule;
+		uint64_t _above{0}; // consecutive windows
+		bool _fired{false};
+	};
+
+	// histograms and time histograms share the layout of the fields a rule reads
+	struct watchedFile
+	{
+		std::vector<size_t> _rules;
+		bool _baseline{false}; // of the file of _inode and _size
+		uint64_t _inode{0};
+		uint64_t _size{0};
+		uint64_t _samplesPerBucket{1};
+		uint64_t _numBuckets{0};
+		uint64_t _numSamples{0};
+		uint64_t _overflows{0};
+		std::vector<uint64_t> _header; // the header page
+		std::vector<uint64_t> _data; // the buckets of the window
+		std::vector<uint64_t> _previous;
+		std::vector<uint64_t> _tail; // [i] - samples of the last window in buckets i and above, [_numBuckets] = 0
+		uint64_t _windowSamples{0};
+		uint64_t _windowOverflows{0};
+		std::string _error; // the last one reported
+	};
+
+	static constexpr size_t headerPage{4096};
+	static_assert(sizeof(shmHistHeader) < headerPage && sizeof(shmTimeHistHeader) < headerPage, "headers of a page");
+
+	// the layout and the counters of the header page, false when it's not a histogram yet
+	static bool layout(watchedFile& watched, uint64_t& numSamples, uint64_t& overflows)
+	{
+		const auto* begin{watched._header.data()};
+		const auto available{(watched._size - headerPage) / sizeof(uint64_t)};
+		if (begin[0] == shmHistHeader::magic())
+		{
+			const auto* header{reinterpret_cast<const shmHistHeader*>(begin)};
+			watched._samplesPerBucket = 1;
+			watched._numBuckets = std::min(header->_numBuckets, available);
+			numSamples = header->_numSamples;
+			overflows = header->_overfows;
+			return watched._numBuckets > 0;
+		}
+		if (begin[0] == shmTimeHistHeader::magic())
+		{
+			const auto* header{reinterpret_cast<const shmTimeHistHeader*>(begin)};
+			watched._samplesPerBucket = std::max<uint64_t>(header->_samplesPerBucket, 1);
+			watched._numBuckets = std::min(header->_numBuckets, available);
+			numSamples = header->_numSamples;
+			overflows = header->_overfows;
+			return watched._numBuckets > 0;
+		}
+		// 0 - the process is writing the file right now
+		if (begin[0] != 0)
+			Throw(std::runtime_error) << "not a histogram, magic: " << std::hex << begin[0] << End;
+		return false;
+	}
+
+	static bool readAll(int fd, void* to, size_t size, off_t offset)
+	{
+		auto* bytes{static_cast<char*>(to)};
+		while (size > 0)
+		{
+			const auto num{::pread(fd, bytes, size, offset)};
+			if (num <= 0)
+				return false;
+			bytes += num;
+			size -= static_cast<size_t>(num);
+			offset += num;
+		}
+		return true;
+	}
+
+	/*
+		false when nothing was recorded since the previous window.
+		the file is read with pread and not mapped: the process truncates it whenever it starts over or a thread
+		takes a recycled instance number (shmFile opens with O_TRUNC), a mapping of a truncated file raises SIGBUS
+		and a short read is only a window without data. a new inode or size takes a new baseline
+	*/
+	bool window(const std::filesystem::path& file, watchedFile& watched)
+	{
+		const auto path{file.is_absolute() ? file : _shmDir / file};
+		const int fd{::open(path.c_str(), O_RDONLY)};
+		if (fd < 0)
+			return false;
+		struct closer
+		{
+			int _fd;
+			~closer() { ::close(_fd); }
+		} closeFd{fd};
+
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < headerPage)
+			return false;
+		const bool replaced{static_cast<uint64_t>(st.st_ino) != watched._inode || static_cast<uint64_t>(st.st_size) != watched._size};
+		watched._inode = static_cast<uint64_t>(st.st_ino);
+		watched._size = static_cast<uint64_t>(st.st_size);
+
+		watched._header.resize(headerPage / sizeof(uint64_t));
+		if (!readAll(fd, watched._header.data(), headerPage, 0))
+			return false;
+		const auto numBuckets{watched._numBuckets};
+		const auto samplesPerBucket{watched._samplesPerBucket};
+		uint64_t numSamples{0};
+		uint64_t overflows{0};
+		if (!layout(watched, numSamples, overflows))
+		{
+			watched._baseline = false;
+			return false;
+		}
+
+		// the first window of a file only takes the baseline, what was recorded before doesn't fire
+		const bool baseline{!watched._baseline || replaced || numBuckets != watched._numBuckets || samplesPerBucket != watched._samplesPerBucket};
+		if (!baseline && numSamples == watched._numSamples)
+			return false;
+
+		watched._data.resize(watched._numBuckets);
+		if (!readAll(fd, watched._data.data(), watched._numBuckets * sizeof(uint64_t), headerPage))
+		{
+			watched._baseline = false;
+			return false;
+		}
+		if (baseline)
+		{
+			watched._previous = watched._data;
+			watched._tail.assign(watched._numBuckets + 1, 0);
+			watched._numSamples = numSamples;
+			watched._overflows = overflows;
+			watched._baseline = true;
+			return false;
+		}
+
+		// the process started over when the counts went back
+		const bool restarted{numSamples < watched._numSamples};
+		uint64_t tail{0};
+		for (auto i = watched._numBuckets; i-- > 0;)
+		{
+			const auto count{watched._data[i]};
+			tail += restarted || count < watched._previous[i] ? count : count - watched._previous[i];
+			watched._tail[i] = tail;
+			watched._previous[i] = count;
+		}
+		watched._windowSamples = restarted ? numSamples : numSamples - watched._numSamples;
+		watched._windowOverflows = restarted || overflows < watched._overflows ? overflows : overflows - watched._overflows;
+		watched._numSamples = numSamples;
+		watched._overflows = overflows;
+		return true;
+	}
+
+	static uint64_t signal(const ruleState& state, const watchedFile& watched, uint64_t elapsedNanos)
+	{
+		const auto& rule{state._rule};
+		if (rule._signal != alertSignal::percentile)
+		{
+			if (elapsedNanos == 0)
+				return 0;
+			const auto count{rule._signal == alertSignal::overflowRate ? watched._windowOverflows : watched._windowSamples};
+			return static_cast<uint64_t>(static_cast<double>(count) * 1e9 / static_cast<double>(elapsedNanos));
+		}
+
+		// the lower bound of the first bucket whose tail holds no more than (100 - percentile)% of the window
+		const auto total{watched._tail[0]};
+		if (total == 0)
+			return 0;
+		const auto limit{static_cast<double>(total) * (100.0 - rule._percentile) / 100.0};
+		const auto it{std::partition_point(watched._tail.begin() + 1, watched._tail.end(),
+			[limit](uint64_t tail) { return static_cast<double>(tail) > limit; })};
+		return static_cast<uint64_t>(it - watched._tail.begin() - 1) * watched._samplesPerBucket;
+	}
+
+	std::filesystem::path _shmDir;
+	std::filesystem::path _dumpDir;
+	std::vector<ruleState> _rules;
+	std::map<std::filesystem::path, watchedFile> _watched;
+	uint64_t _lastNanos{0};
+};
+
+}
@@ -0,0 +1,141 @@
+/*
+	replaces the global operator new and delete - plain, array, nothrow, aligned and sized.
+	every allocation of a thread is recorded into its allocMetrics, see allocHooks.h.
+
+	the hooks must never recurse into themselves: the histograms are created on the first
+	allocation of a thread with the thread marked busy, so whatever they allocate goes straight
+	to malloc, and recording only touches the already mapped shm.
+*/
+#if defined (ENABLE_HIST_PROFILER)
+
+#include "allocHooks.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+// set by the static initializer of this file, allocations before that are not recorded
+std::atomic<bool> hooksReady{false};
+
+// trivially destructible, valid for the whole life of the thread
+thread_local bool threadBusy{false};
+thread_local bool threadExited{false};
+
+struct readyMarker final
+{
+	readyMarker() { hooksReady.store(true, std::memory_order_release); }
+};
+readyMarker marker;
+
+struct busyGuard final
+{
+	busyGuard() { threadBusy = true; }
+	~busyGuard() { threadBusy = false; }
+};
+
+void* rawAllocate(std::size_t size, std::size_t alignment)
+{
+	if (size == 0)
+		size = 1;
+	if (alignment <= alignof(std::max_align_t))
+		return std::malloc(size);
+
+	void* ptr{nullptr};
+	if (::posix_memalign(&ptr, alignment, size) != 0)
+		return nullptr;
+	return ptr;
+}
+
+void* allocate(std::size_t size, std::size_t alignment)
+{
+	if (threadBusy || !hooksReady.load(std::memory_order_acquire))
+		return rawAllocate(size, alignment);
+
+	auto* metrics{profiler::threadAllocMetrics()};
+	if (metrics == nullptr)
+		return rawAllocate(size, alignment);
+
+	const auto begin{profiler::latencyToken::now()};
+	auto* ptr{rawAllocate(size, alignment)};
+	const auto nanos{begin.elapsedNanos()};
+
+	busyGuard guard;
+	metrics->_sizes.sample(profiler::allocSizeBucket(size));
+	metrics->_latency.sample(static_cast<uint64_t>(nanos > 0 ? nanos : 0));
+	return ptr;
+}
+
+// the throwing flavour, calls the new handler until it gives up
+void* allocateOrThrow(std::size_t size, std::size_t alignment)
+{
+	for (;;)
+	{
+		if (auto* ptr{allocate(size, alignment)})
+			return ptr;
+
+		auto handler{std::get_new_handler()};
+		if (handler == nullptr)
+			throw std::bad_alloc{};
+		handler();
+	}
+}
+
+}
+
+namespace profiler
+{
+
+allocMetrics::allocMetrics(metricInstance sizes, metricInstance latency)
+: _sizes{allocSizeBuckets, "allocSizes", sizes, "log2(bytes) + 1", "allocation sizes"}
+, _latency{10, 1000, "allocLatency", latency, "allocation latency"}
+{}
+
+// members are destroyed after this, their deallocations already pass through
+allocMetrics::~allocMetrics()
+{
+	threadExited = true;
+}
+
+allocMetrics* threadAllocMetrics()
+{
+	if (threadExited || !hooksReady.load(std::memory_order_acquire))
+		return nullptr;
+
+	busyGuard guard;
+	static metricSite sizesSite{"allocSizes", "allocation sizes", metricKind::histogram};
+	static metricSite latencySite{"allocLatency", "allocation latency", metricKind::timeHistogram};
+	thread_local allocMetrics metrics{sizesSite.nextInstance(), latencySite.nextInstance()};
+	return &metrics;
+}
+
+}
+
+void* operator new(std::size_t size) { return allocateOrThrow(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return allocateOrThrow(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, alignof(std::max_align_t)); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateOrThrow(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateOrThrow(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate(size, static_cast<std::size_t>(alignment)); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+#endif
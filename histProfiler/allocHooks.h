@@ -0,0 +1,35 @@
+#pragma once
+
+#include "histogram.h"
+
+namespace profiler
+{
+
+/*
+	per thread histograms fed by the global operator new replaced in allocHooks.cpp.
+	opt in by adding histProfiler/allocHooks.cpp to the executable, it compiles to nothing
+	without ENABLE_HIST_PROFILER.
+
+	shmFile_allocSizes_<instance>.shm - log2 buckets, bucket k holds sizes in [2^(k-1), 2^k), 0 in bucket 0
+	shmFile_allocLatency_<instance>.shm - nanos spent in the underlying allocator
+*/
+constexpr size_t allocSizeBuckets{65};
+
+inline uint64_t allocSizeBucket(size_t size)
+{
+	return size == 0 ? 0 : 64 - static_cast<uint64_t>(__builtin_clzll(size));
+}
+
+struct allocMetrics final
+{
+	allocMetrics(metricInstance sizes, metricInstance latency);
+	~allocMetrics();
+
+	histogram _sizes;
+	timeHistogram _latency;
+};
+
+// histograms of the calling thread, nullptr when the hooks don't record (before static init, after thread exit)
+allocMetrics* threadAllocMetrics();
+
+}
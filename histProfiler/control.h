@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+
+#include "shmFile.h"
+
+namespace profiler
+{
+
+/*
+	runtime control of the metrics of a process, one entry per call site (registry slot).
+	an operator tool (histCtl) maps shmFile_control_<pid>.shm, writes the settings
+	and then bumps _state, the metrics compare _state with the one they last applied,
+	so the hot path is a single compare of a word that is almost always in the cache.
+*/
+struct shmControlHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE00000005; }
+public:
+	shmControlHeader() = default;
+	shmControlHeader(size_t maxEntries)
+	: _magic{magic()}, _pid{static_cast<uint64_t>(::getpid())}, _maxEntries{maxEntries}
+	{}
+
+	uint64_t _magic{0};
+	uint64_t _pid{0};
+	uint64_t _maxEntries{0};
+	uint64_t _numEntries{0};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmControlHeader& obj)
+{
+	stream << "control page of pid: " << obj._pid << ", _numEntries: " << obj._numEntries << ", _maxEntries: " << obj._maxEntries;
+	return stream;
+}
+
+struct controlEntry
+{
+	static constexpr uint64_t enabledBit() { return 1; }
+	static constexpr uint64_t makeState(uint64_t generation, bool enabled) { return (generation << 1) | (enabled ? enabledBit() : 0); }
+
+	uint64_t state() const { return __atomic_load_n(&_state, __ATOMIC_ACQUIRE); }
+	static bool enabled(uint64_t state) { return (state & enabledBit()) != 0; }
+	static uint64_t generation(uint64_t state) { return state >> 1; }
+
+	// operator side, publishes the settings written before it
+	void update(bool enable)
+	{
+		__atomic_store_n(&_state, makeState(generation(state()) + 1, enable), __ATOMIC_RELEASE);
+	}
+
+	char _id[64] = {'\0'};
+	uint64_t _kind{0};
+	uint64_t _slot{0};
+	uint64_t _state{makeState(0, true)};
+	uint64_t _samplingRatio{0}; // 0 - as configured at the call site
+	uint64_t _samplesPerBucket{0}; // 0 - as configured at the call site
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const controlEntry& obj)
+{
+	const auto state{obj.state()};
+	stream << obj._slot << ": " << obj._id << (controlEntry::enabled(state) ? " enabled" : " disabled")
+		<< ", generation: " << controlEntry::generation(state)
+		<< ", _samplingRatio: " << obj._samplingRatio << ", _samplesPerBucket: " << obj._samplesPerBucket;
+	return stream;
+}
+
+class controlPage final
+{
+public:
+	static controlPage& instance(size_t maxEntries)
+	{
+		static controlPage page{maxEntries};
+		return page;
+	}
+
+	// for metrics created without a call site, always enabled and never changes
+	static const controlEntry& alwaysOn()
+	{
+		static const controlEntry entry;
+		return entry;
+	}
+
+	controlEntry& add(size_t slot, const char* id, uint64_t kind)
+	{
+		auto& entry{_shmControl.data()[slot]};
+		entry = controlEntry{};
+		strncpy(entry._id, id, sizeof(entry._id) - 1);
+		entry._kind = kind;
+		entry._slot = slot;
+
+		auto& header{_shmControl.header()};
+		if (slot >= header._numEntries)
+			__atomic_store_n(&header._numEntries, slot + 1, __ATOMIC_RELEASE);
+		return entry;
+	}
+
+private:
+	controlPage(size_t maxEntries)
+	: _shmControl{"shmFile_control_" + std::to_string(::getpid()) + ".shm", shmControlHeader{maxEntries}, maxEntries}
+	{}
+
+	shmFile<shmControlHeader, controlEntry> _shmControl;
+};
+
+/*
+	the metric side of a control entry.
+	_appliedState always has the enabled bit, so a disabled entry never compares equal
+	and the metric keeps returning from the cold path
+*/
+class controlled final
+{
+public:
+	explicit controlled(const controlEntry* control)
+	: _control{control}
+	{}
+
+	// onChange(entry) applies the operator settings, called once per new generation
+	template <typename onChange_t>
+	bool enabled(onChange_t&& onChange)
+	{
+		return _control->state() == _appliedState || refresh(onChange);
+	}
+
+	const controlEntry& entry() const { return *_control; }
+
+private:
+	template <typename onChange_t>
+	[[gnu::noinline, gnu::cold]] bool refresh(onChange_t&& onChange)
+	{
+		const auto state{_control->state()};
+		if (!controlEntry::enabled(state))
+			return false;
+		_appliedState = state;
+		onChange(*_control);
+		return true;
+	}
+
+	const controlEntry* _control;
+	uint64_t _appliedState{controlEntry::makeState(0, true)};
+};
+
+}
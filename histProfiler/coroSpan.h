@@ -0,0 +1,123 @@
+#pragma once
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#include "cpuTimeHistogram.h"
+
+namespace profiler
+{
+
+/*
+	latency of a coroutine, or of a part of it, that may suspend and resume on any thread.
+	the span lives in the coroutine frame, so does its begin time - unlike a thread_local timeHistogram
+	it survives suspension, a resume on another thread and other coroutines interleaving on the same thread.
+
+	records into the cpuTimeHistogram of the thread the span ends on:
+		wall - total latency, cpu - on cpu while running, off cpu - suspended or not scheduled.
+	only awaits wrapped with spanAwait() pause the cpu time, so any executor works, nothing is
+	required from the promise type.
+*/
+class coroSpan final
+{
+public:
+	// returns the histogram of the calling thread, called again on every thread the span ends on
+	using histogram_t = cpuTimeHistogram& (*)();
+
+	explicit coroSpan(histogram_t hist)
+	: _hist{hist}
+	{
+		tscCalibration::instance();
+		_beginWall = latencyToken::now();
+		_resumedCpu = cpuTimeHistogram::threadCpuNanos();
+	}
+	~coroSpan()
+	{
+		if (_running)
+			suspend();
+		const auto wall{static_cast<uint64_t>(std::max<int64_t>(_beginWall.elapsedNanos(), 0))};
+		_hist().sample(wall, _cpu);
+	}
+	coroSpan(const coroSpan&) = delete;
+	coroSpan& operator=(const coroSpan&) = delete;
+
+	// cpu time is per thread, it's read on the thread that suspends and on the one that resumes
+	void suspend()
+	{
+		_cpu += cpuTimeHistogram::threadCpuNanos() - _resumedCpu;
+		_running = false;
+	}
+	void resume()
+	{
+		_resumedCpu = cpuTimeHistogram::threadCpuNanos();
+		_running = true;
+	}
+
+private:
+	histogram_t _hist;
+	latencyToken _beginWall;
+	uint64_t _resumedCpu{0};
+	uint64_t _cpu{0};
+	bool _running{true};
+};
+
+/*
+	forwards to the awaiter of an awaitable and pauses the span while suspended.
+	awaitables with a member operator co_await are unwrapped, pass the awaiter
+	for those with a free operator co_await
+*/
+template <typename awaiter_t>
+struct spanAwaiter
+{
+	bool await_ready() { return _awaiter.await_ready(); }
+
+	template <typename promise_t>
+	decltype(auto) await_suspend(std::coroutine_handle<promise_t> handle)
+	{
+		_span.suspend();
+		try
+		{
+			return _awaiter.await_suspend(handle);
+		}
+		catch (...)
+		{
+			// the coroutine is resumed with the exception, await_resume is not called
+			_span.resume();
+			throw;
+		}
+	}
+
+	decltype(auto) await_resume()
+	{
+		_span.resume();
+		return _awaiter.await_resume();
+	}
+
+	coroSpan& _span;
+	awaiter_t _awaiter; // a reference unless operator co_await returned it by value
+};
+
+template <typename awaitable_t>
+decltype(auto) getAwaiter(awaitable_t&& awaitable)
+{
+	if constexpr (requires { std::forward<awaitable_t>(awaitable).operator co_await(); })
+		return std::forward<awaitable_t>(awaitable).operator co_await();
+	else
+		return static_cast<std::remove_reference_t<awaitable_t>&>(awaitable);
+}
+
+// temporaries of the co_await expression live in the frame until it resumes, references are safe
+template <typename awaitable_t>
+auto spanAwait(coroSpan& span, awaitable_t&& awaitable)
+{
+	using awaiter_t = decltype(getAwaiter(std::forward<awaitable_t>(awaitable)));
+	return spanAwaiter<awaiter_t>{span, getAwaiter(std::forward<awaitable_t>(awaitable))};
+}
+
+}
+
+#endif
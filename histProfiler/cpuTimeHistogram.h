@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string.h>
+#include <time.h>
+
+#include "shmFile.h"
+#include "registry.h"
+#include "latencyStamp.h"
+
+namespace profiler
+{
+
+// statistics of one of the histograms of a region
+struct shmRegionStats
+{
+	void resetSamples()
+	{
+		_maxSample = _overfows = _sum = _numSamples = 0;
+		_minSample = std::numeric_limits<uint64_t>::max();
+	}
+
+	void record(uint64_t sample, uint64_t perBucket, uint64_t numBuckets, uint64_t* data)
+	{
+		if (sample > _maxSample)
+			_maxSample = sample;
+		if (sample < _minSample)
+			_minSample = sample;
+
+		const auto bucket{perBucket > 1 ? sample / perBucket : sample};
+		if (bucket < numBuckets - 1)
+		{
+			++data[bucket];
+		}
+		else
+		{
+			++_overfows;
+			++data[numBuckets - 1];
+		}
+
+		_sum += bucket;
+		++_numSamples;
+	}
+
+	uint64_t _maxSample{0};
+	uint64_t _minSample{std::numeric_limits<uint64_t>::max()};
+	uint64_t _overfows{0};
+	uint64_t _sum{0};
+	uint64_t _numSamples{0};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmRegionStats& obj)
+{
+	auto mean{obj._numSamples > 0 ? obj._sum / obj._numSamples : 0};
+	stream << "_maxSample: " << obj._maxSample << ", _minSample: " << obj._minSample
+		<< ", _overfows: " << obj._overfows << ", mean: " << mean << ", _numSamples: " << obj._numSamples;
+	return stream;
+}
+
+/*
+	wall time, cpu time of the thread and their difference - the time the region
+	was not running: waiting in the run queue, blocked, sleeping.
+	data holds 3 arrays of _numBuckets, all in _samplesPerBucket nanos:
+	[0, _numBuckets) - wall, [_numBuckets, 2 * _numBuckets) - cpu, [2 * _numBuckets, 3 * _numBuckets) - off cpu
+*/
+struct shmCpuTimeHistHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE00000007; }
+public:
+	shmCpuTimeHistHeader() = default;
+	shmCpuTimeHistHeader(size_t samplesPerBucket, size_t numBuckets, const std::string& desc)
+	: _magic{magic()}, _samplesPerBucket{samplesPerBucket}, _numBuckets{numBuckets}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+	void resetSamples()
+	{
+		_wall.resetSamples();
+		_cpu.resetSamples();
+		_offCpu.resetSamples();
+	}
+
+	uint64_t _magic{0};
+	uint64_t _samplesPerBucket{1};
+	uint64_t _numBuckets{0};
+	char _description[128] = {'\0'};
+	shmRegionStats _wall;
+	shmRegionStats _cpu;
+	shmRegionStats _offCpu;
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmCpuTimeHistHeader& obj)
+{
+	stream << obj._description
+		<< " : _numBuckets: " << obj._numBuckets << ", _samplesPerBucket: " << obj._samplesPerBucket << std::endl
+		<< "\twall : " << obj._wall << std::endl
+		<< "\tcpu : " << obj._cpu << std::endl
+		<< "\toff cpu : " << obj._offCpu;
+	return stream;
+}
+
+/*
+	separates "slow because busy" from "slow because not scheduled".
+	wall time is read from the TSC (see latencyToken) and cpu time with CLOCK_THREAD_CPUTIME_ID,
+	the cheapest sources that don't need perf events or a getrusage per region
+*/
+struct cpuTimeHistogram
+{
+	cpuTimeHistogram(uint64_t samplesPerBucket, uint64_t numBuckets,
+			const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				shmCpuTimeHistHeader{samplesPerBucket, numBuckets, desc},
+				3 * numBuckets}
+	, _control{cnt._control}
+	, _configuredSamplesPerBucket{samplesPerBucket}
+	{
+		// calibrates now, not inside the first region
+		tscCalibration::instance();
+	}
+
+	static uint64_t threadCpuNanos()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+	}
+
+	void begin()
+	{
+		_sampled = _control.enabled([this](const controlEntry& entry){ applyControl(entry); });
+		if (!_sampled)
+			return;
+
+		_beginCpu = threadCpuNanos();
+		_beginWall = latencyToken::now();
+	}
+
+	void end()
+	{
+		if (!_sampled)
+			return;
+
+		const auto wall{static_cast<uint64_t>(std::max<int64_t>(_beginWall.elapsedNanos(), 0))};
+		const auto cpu{threadCpuNanos() - _beginCpu};
+		sample(wall, cpu);
+	}
+
+	void sample(uint64_t wall, uint64_t cpu)
+	{
+		auto& header{_shmHist.header()};
+		auto* data{_shmHist.data()};
+		const auto perBucket{header._samplesPerBucket};
+		const auto numBuckets{header._numBuckets};
+
+		header._wall.record(wall, perBucket, numBuckets, data);
+		header._cpu.record(cpu, perBucket, numBuckets, data + numBuckets);
+		// the 2 clocks have different resolutions, a busy region may read a bit more cpu than wall
+		header._offCpu.record(wall > cpu ? wall - cpu : 0, perBucket, numBuckets, data + 2 * numBuckets);
+	}
+
+	void applyControl(const controlEntry& entry)
+	{
+		auto& header{_shmHist.header()};
+		const auto perBucket{entry._samplesPerBucket > 0 ? entry._samplesPerBucket : _configuredSamplesPerBucket};
+		if (perBucket != header._samplesPerBucket)
+		{
+			resetSamples();
+			header._samplesPerBucket = perBucket;
+		}
+	}
+
+	void resetSamples()
+	{
+		_shmHist.header().resetSamples();
+		memset(_shmHist.dataAs<void*>(), 0, (_shmHist.endData() - _shmHist.data()) * sizeof(uint64_t));
+	}
+
+	shmFile<shmCpuTimeHistHeader, uint64_t> _shmHist;
+	latencyToken _beginWall;
+	uint64_t _beginCpu{0};
+	bool _sampled{false};
+
+	controlled _control;
+	uint64_t _configuredSamplesPerBucket{1};
+};
+
+}
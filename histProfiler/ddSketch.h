@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include "shmFile.h"
+#include "registry.h"
+#include "latencyStamp.h"
+
+namespace profiler
+{
+
+/*
+	DDSketch: a sample v >= 1 nano goes to the bucket key = ceil(log(v) / log(gamma)),
+	gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy).
+	every value of a bucket is within relativeAccuracy of 2 * gamma^key / (gamma + 1),
+	so the quantiles are within relativeAccuracy of the exact ones over any range.
+
+	the data holds _maxBuckets counters of the keys [_minKey, _minKey + _maxBuckets).
+	a sample above the window moves it up and folds the lowest keys into the new lowest one,
+	a sample below it goes to the lowest bucket when the window can't move down.
+	only the quantiles up to the value of _collapsedKey lose their accuracy, the high ones are what latency is about.
+	sketches of the same gamma add up bucket by bucket, see mergedSketch
+*/
+struct shmSketchHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE00000009; }
+public:
+	shmSketchHeader() = default;
+	shmSketchHeader(double relativeAccuracy, uint64_t maxBuckets, const std::string& desc)
+	: _magic{magic()}
+	, _relativeAccuracy{relativeAccuracy}
+	, _gamma{(1 + relativeAccuracy) / (1 - relativeAccuracy)}
+	, _maxBuckets{maxBuckets}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+
+	void resetSamples()
+	{
+		_minKey = _maxKey = 0;
+		_collapsedKey = std::numeric_limits<int64_t>::min();
+		_zeroCount = _collapsed = _maxSample = _sum = _numSamples = 0;
+		_minSample = std::numeric_limits<uint64_t>::max();
+	}
+
+	uint64_t _magic{0};
+	double _relativeAccuracy{0};
+	double _gamma{0};
+	uint64_t _maxBuckets{0};
+	int64_t _minKey{0}; // key of data[0]
+	int64_t _maxKey{0}; // highest key in use
+	uint64_t _zeroCount{0}; // samples below 1 nano, they have no key
+	int64_t _collapsedKey{std::numeric_limits<int64_t>::min()}; // the highest key that holds samples of lower keys
+	uint64_t _collapsed{0}; // moves of samples to the lowest bucket, a sample may move more than once
+	uint64_t _maxSample{0};
+	uint64_t _minSample{std::numeric_limits<uint64_t>::max()};
+	uint64_t _sum{0};
+	uint64_t _numSamples{0};
+	char _description[128] = {'\0'};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmSketchHeader& obj)
+{
+	auto mean{obj._numSamples > 0 ? obj._sum / obj._numSamples : 0};
+	stream << obj._description
+		<< " : _relativeAccuracy: " << obj._relativeAccuracy << ", _maxBuckets: " << obj._maxBuckets
+		<< ", keys: [" << obj._minKey << ", " << obj._maxKey << "], _zeroCount: " << obj._zeroCount
+		<< ", _collapsed: " << obj._collapsed << ", _collapsedKey: " << obj._collapsedKey
+		<< ", _maxSample: " << obj._maxSample << ", _minSample: " << obj._minSample
+		<< ", mean: " << mean << ", _numSamples: " << obj._numSamples;
+	return stream;
+}
+
+// the value a bucket stands for, within the relative accuracy of all its values
+inline double sketchValue(double gamma, int64_t key)
+{
+	return 2 * std::pow(gamma, static_cast<double>(key)) / (gamma + 1);
+}
+
+// q in [0, 1], counts[i] is the count of the key minKey + i
+inline double sketchQuantile(double gamma, uint64_t zeroCount, int64_t minKey, const uint64_t* counts, size_t numCounts, double q)
+{
+	uint64_t total{zeroCount};
+	for (size_t i = 0; i < numCounts; ++i)
+		total += counts[i];
+	if (total == 0)
+		return 0;
+
+	const auto rank{static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(total - 1))};
+	if (rank < zeroCount)
+		return 0;
+	uint64_t cumulative{zeroCount};
+	for (size_t i = 0; i < numCounts; ++i)
+	{
+		cumulative += counts[i];
+		if (cumulative > rank)
+			return sketchValue(gamma, minKey + static_cast<int64_t>(i));
+	}
+	return sketchValue(gamma, minKey + static_cast<int64_t>(numCounts) - 1);
+}
+
+inline double sketchQuantile(const shmSketchHeader& header, const uint64_t* data, double q)
+{
+	const auto used{header._numSamples > header._zeroCount ? static_cast<size_t>(header._maxKey - header._minKey + 1) : 0};
+	return sketchQuantile(header._gamma, header._zeroCount, header._minKey, data, used, q);
+}
+
+/*
+	reader side sum of sketches of many threads and processes, not bounded by _maxBuckets:
+	the counts of every key add up exactly, as if one sketch saw all the samples
+*/
+struct mergedSketch
+{
+	void merge(const shmSketchHeader& header, const uint64_t* data)
+	{
+		if (_numSamples == 0 && _gamma == 0)
+			_gamma = header._gamma;
+		else if (header._gamma != _gamma)
+			Throw(std::runtime_error) << "sketches of different accuracies can't be merged exactly: "
+									  << header._description << ", gamma: " << header._gamma << ", expected: " << _gamma << End;
+
+		_zeroCount += header._zeroCount;
+		_collapsed += header._collapsed;
+		_collapsedKey = std::max(_collapsedKey, header._collapsedKey);
+		_sum += header._sum;
+		_numSamples += header._numSamples;
+		_maxSample = std::max(_maxSample, header._maxSample);
+		_minSample = std::min(_minSample, header._minSample);
+		if (header._numSamples == header._zeroCount)
+			return;
+
+		if (_counts.empty())
+		{
+			_minKey = header._minKey;
+		}
+		else if (header._minKey < _minKey)
+		{
+			_counts.insert(_counts.begin(), static_cast<size_t>(_minKey - header._minKey), 0);
+			_minKey = header._minKey;
+		}
+		const auto last{static_cast<size_t>(header._maxKey - _minKey)};
+		if (_counts.size() <= last)
+			_counts.resize(last + 1, 0);
+		for (int64_t key = header._minKey; key <= header._maxKey; ++key)
+			_counts[static_cast<size_t>(key - _minKey)] += data[key - header._minKey];
+	}
+
+	double quantile(double q) const
+	{
+		return sketchQuantile(_gamma, _zeroCount, _minKey, _counts.data(), _counts.size(), q);
+	}
+
+	double _gamma{0};
+	int64_t _minKey{0};
+	std::vector<uint64_t> _counts;
+	int64_t _collapsedKey{std::numeric_limits<int64_t>::min()};
+	uint64_t _zeroCount{0};
+	uint64_t _collapsed{0};
+	uint64_t _maxSample{0};
+	uint64_t _minSample{std::numeric_limits<uint64_t>::max()};
+	uint64_t _sum{0};
+	uint64_t _numSamples{0};
+};
+
+/*
+	a timeHistogram backend that needs no range up front: begin(), end(), sample() and consume()
+	like timeHistogram, so a call site switches by its declaration only.
+	_maxBuckets * 8 bytes of data, e.g. 1% accuracy from 1 nano to an hour fits in ~1100 buckets
+*/
+struct timeSketch
+{
+	timeSketch(double relativeAccuracy, uint64_t maxBuckets,
+			const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				shmSketchHeader{relativeAccuracy, std::max<uint64_t>(maxBuckets, 1), desc},
+				std::max<uint64_t>(maxBuckets, 1)}
+	, _multiplier{1 / std::log(_shmHist.header()._gamma)}
+	, _control{cnt._control}
+	{
+		// calibrates now for consume(), not on the first message
+		tscCalibration::instance();
+	}
+
+	void begin()
+	{
+		_sampled = _control.enabled([](const controlEntry&){});
+		if (_sampled)
+			_begin = std::chrono::system_clock::now();
+	}
+	void end(uint64_t /*tag*/ = 0)
+	{
+		if (!_sampled)
+			return;
+		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now() - _begin)};
+		record(static_cast<uint64_t>(diffNanos.count()));
+	}
+
+	void sample(std::chrono::time_point<std::chrono::system_clock> begin, std::chrono::time_point<std::chrono::system_clock> end, uint64_t tag = 0)
+	{
+		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)};
+		sample(static_cast<uint64_t>(std::max<int64_t>(diffNanos.count(), 0)), tag);
+	}
+	void sample(uint64_t sample, uint64_t /*tag*/ = 0)
+	{
+		if (_control.enabled([](const controlEntry&){}))
+			record(sample);
+	}
+
+	void consume(latencyToken token, uint64_t tag = 0)
+	{
+		sample(static_cast<uint64_t>(std::max<int64_t>(token.elapsedNanos(), 0)), tag);
+	}
+
+	void record(uint64_t sample)
+	{
+		auto& header{_shmHist.header()};
+
+		if (sample > header._maxSample)
+			header._maxSample = sample;
+		if (sample < header._minSample)
+			header._minSample = sample;
+		header._sum += sample;
+
+		if (sample == 0)
+			++header._zeroCount;
+		else
+			++_shmHist.data()[slot(key(sample))];
+		++header._numSamples;
+	}
+
+	int64_t key(uint64_t sample) const
+	{
+		return static_cast<int64_t>(std::ceil(std::log(static_cast<double>(sample)) * _multiplier));
+	}
+
+	// index of the key in the data, moves or collapses the window when the key is outside of it
+	size_t slot(int64_t key)
+	{
+		auto& header{_shmHist.header()};
+		auto* data{_shmHist.data()};
+		const auto maxBuckets{static_cast<int64_t>(header._maxBuckets)};
+
+		if (header._numSamples == header._zeroCount)
+		{
+			header._minKey = header._maxKey = key;
+			return 0;
+		}
+		if (key < header._minKey)
+		{
+			if (header._maxKey - key >= maxBuckets)
+			{
+				++header._collapsed;
+				header._collapsedKey = std::max(header._collapsedKey, header._minKey);
+				return 0;
+			}
+			const auto shift{static_cast<size_t>(header._minKey - key)};
+			memmove(data + shift, data, static_cast<size_t>(header._maxKey - header._minKey + 1) * sizeof(uint64_t));
+			memset(data, 0, shift * sizeof(uint64_t));
+			header._minKey = key;
+		}
+		else if (key >= header._minKey + maxBuckets)
+		{
+			const auto newMinKey{key - maxBuckets + 1};
+			const auto shift{static_cast<size_t>(std::min(newMinKey - header._minKey, maxBuckets))};
+			uint64_t folded{0};
+			for (size_t i = 0; i < shift; ++i)
+				folded += data[i];
+			memmove(data, data + shift, (header._maxBuckets - shift) * sizeof(uint64_t));
+			memset(data + header._maxBuckets - shift, 0, shift * sizeof(uint64_t));
+			data[0] += folded;
+			header._collapsed += folded;
+			header._collapsedKey = newMinKey;
+			header._minKey = newMinKey;
+		}
+		header._maxKey = std::max(header._maxKey, key);
+		return static_cast<size_t>(key - header._minKey);
+	}
+
+	double quantile(double q) const
+	{
+		return sketchQuantile(_shmHist.header(), _shmHist.data(), q);
+	}
+
+	void resetSamples()
+	{
+		_shmHist.header().resetSamples();
+		memset(_shmHist.dataAs<void*>(), 0, (_shmHist.endData() - _shmHist.data()) * sizeof(uint64_t));
+	}
+
+	shmFile<shmSketchHeader, uint64_t> _shmHist;
+	double _multiplier; // 1 / log(gamma)
+	std::chrono::time_point<std::chrono::system_clock> _begin;
+	bool _sampled{false};
+	controlled _control;
+};
+
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+
+#include "shmFile.h"
+#include "control.h"
+#include "utils.h"
+
+namespace profiler
+{
+
+/*
+	the last regions of a thread in the order they ended, shmFile_events_<pid>_<tid>.shm.
+	a single producer ring of _numRecords, the record of the n-th region (from 0) is at n % _numRecords
+	and _head is the number of regions written. the producer stores the record and then _head with release,
+	a reader copies the records, reads _head again and drops the ones the producer may have overwritten meanwhile,
+	the slot after _head may be in the middle of a write, so readers see up to _numRecords - 1
+*/
+struct shmEventRingHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE0000000B; }
+public:
+	shmEventRingHeader() = default;
+	shmEventRingHeader(uint64_t numRecords)
+	: _magic{magic()}, _pid{static_cast<uint64_t>(::getpid())}, _threadId{threadId()}, _numRecords{numRecords}
+	{}
+
+	uint64_t _magic{0};
+	uint64_t _pid{0};
+	uint64_t _threadId{0};
+	uint64_t _numRecords{0};
+	uint64_t _head{0};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmEventRingHeader& obj)
+{
+	stream << "events of pid: " << obj._pid << ", thread: " << obj._threadId
+		<< ", _numRecords: " << obj._numRecords << ", _head: " << obj._head;
+	return stream;
+}
+
+struct eventRecord
+{
+	static constexpr uint64_t noRegion() { return ~uint64_t{0}; }
+
+	uint64_t _region{noRegion()}; // slot of the call site in the control page
+	uint64_t _beginNanos{0}; // system clock
+	uint64_t _durationNanos{0};
+};
+
+/*
+	off unless the process sets the number of records per thread, before its threads record:
+	profiler::eventRing::configure(4096);
+	a thread creates its ring with the first region it ends, a write is 3 stores and a release store
+*/
+class eventRing final
+{
+public:
+	static void configure(uint64_t numRecords) { configured().store(numRecords, std::memory_order_relaxed); }
+
+	// nullptr when the process didn't configure a ring
+	static eventRing* local()
+	{
+		thread_local std::unique_ptr<eventRing> ring;
+		if (ring)
+			return ring.get();
+
+		const auto numRecords{configured().load(std::memory_order_relaxed)};
+		if (numRecords == 0)
+			return nullptr;
+		ring.reset(new eventRing{numRecords});
+		return ring.get();
+	}
+
+	void write(uint64_t region, uint64_t beginNanos, uint64_t durationNanos)
+	{
+		auto& record{_records[_head & _mask]};
+		record._region = region;
+		record._beginNanos = beginNanos;
+		record._durationNanos = durationNanos;
+		__atomic_store_n(&_shmRing.header()._head, ++_head, __ATOMIC_RELEASE);
+	}
+
+	// region of the records of a metric, call sites that were not registered have none
+	static uint64_t regionOf(const controlEntry& entry)
+	{
+		return &entry == &controlPage::alwaysOn() ? eventRecord::noRegion() : entry._slot;
+	}
+
+	static std::string fileName(uint64_t pid, uint64_t tid)
+	{
+		return "shmFile_events_" + std::to_string(pid) + "_" + std::to_string(tid) + ".shm";
+	}
+
+	shmFile<shmEventRingHeader, eventRecord> _shmRing;
+
+private:
+	// a power of 2, so the slot is a mask, and at least numRecords for readers
+	explicit eventRing(uint64_t numRecords)
+	: _shmRing{fileName(static_cast<uint64_t>(::getpid()), threadId()), shmEventRingHeader{roundUp(numRecords + 1)}, roundUp(numRecords + 1)}
+	, _records{_shmRing.data()}
+	, _mask{_shmRing.header()._numRecords - 1}
+	{}
+
+	static uint64_t roundUp(uint64_t numRecords)
+	{
+		uint64_t size{1};
+		while (size < numRecords)
+			size <<= 1;
+		return size;
+	}
+
+	static std::atomic<uint64_t>& configured()
+	{
+		static std::atomic<uint64_t> numRecords{0};
+		return numRecords;
+	}
+
+	eventRecord* _records;
+	uint64_t _mask;
+	uint64_t _head{0};
+};
+
+// the records of a ring that were not overwritten while they were copied, oldest first
+inline std::vector<eventRecord> snapshot(const shmFile<shmEventRingHeader, eventRecord>& ring)
+{
+	const auto& header{ring.header()};
+	const auto numRecords{std::min<uint64_t>(header._numRecords, ring.endData() - ring.data())};
+	if (header._magic != shmEventRingHeader::magic() || numRecords == 0)
+		return {};
+
+	const auto head{__atomic_load_n(&header._head, __ATOMIC_ACQUIRE)};
+	const auto first{head > numRecords ? head - numRecords : 0};
+	std::vector<eventRecord> records;
+	records.reserve(head - first);
+	for (auto index = first; index < head; ++index)
+		records.push_back(ring.data()[index % numRecords]);
+
+	// the producer is writing the record after the head it published, at the slot of the oldest one
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	const auto headAfter{__atomic_load_n(&header._head, __ATOMIC_ACQUIRE)};
+	const auto firstValid{headAfter >= numRecords ? headAfter - numRecords + 1 : 0};
+	if (firstValid > first)
+		records.erase(records.begin(), records.begin() + std::min<uint64_t>(firstValid - first, records.size()));
+	return records;
+}
+
+/*
+	Chrome trace event format, opens in chrome://tracing and ui.perfetto.dev:
+	a complete ("X") event per record, the names of the regions are the ids in the control page of the process
+*/
+class chromeTrace final
+{
+public:
+	explicit chromeTrace(std::ostream& stream)
+	: _stream{stream}
+	{
+		_stream << "{\"traceEvents\":[";
+	}
+	chromeTrace(const chromeTrace&) = delete;
+	chromeTrace& operator=(const chromeTrace&) = delete;
+	~chromeTrace()
+	{
+		_stream << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+	}
+
+	// the control page is looked up next to the ring, returns the number of events
+	size_t add(const std::filesystem::path& ringFile)
+	{
+		const shmFile<shmEventRingHeader, eventRecord> ring{ringFile};
+		const auto& header{ring.header()};
+		if (header._magic != shmEventRingHeader::magic())
+			Throw(std::runtime_error) << ringFile << " is not an event ring, magic: " << std::hex << header._magic << End;
+
+		const auto& names{namesOf(ringFile.parent_path(), header._pid)};
+		const auto records{snapshot(ring)};
+		for (const auto& record : records)
+		{
+			const auto name{names.find(record._region)};
+			separator();
+			_stream << "\n{\"name\":\"";
+			if (name != names.end())
+				_stream << name->second;
+			else
+				_stream << "region " << static_cast<int64_t>(record._region);
+			_stream << "\",\"cat\":\"timeHist\",\"ph\":\"X\",\"ts\":" << micros{record._beginNanos}
+				<< ",\"dur\":" << micros{record._durationNanos}
+				<< ",\"pid\":" << header._pid << ",\"tid\":" << header._threadId << '}';
+		}
+		return records.size();
+	}
+
+private:
+	struct micros
+	{
+		uint64_t _nanos;
+	};
+	friend std::ostream& operator<<(std::ostream& stream, micros obj)
+	{
+		stream << obj._nanos / 1000 << '.' << std::setw(3) << std::setfill('0') << obj._nanos % 1000 << std::setfill(' ');
+		return stream;
+	}
+
+	void separator()
+	{
+		if (_numEvents++ > 0)
+			_stream << ',';
+	}
+
+	const std::map<uint64_t, std::string>& namesOf(const std::filesystem::path& dir, uint64_t pid)
+	{
+		auto [it, inserted]{_names.try_emplace(pid)};
+		const auto control{dir / ("shmFile_control_" + std::to_string(pid) + ".shm")};
+		std::error_code ec;
+		if (!inserted || !std::filesystem::is_regular_file(control, ec))
+			return it->second;
+
+		const shmFile<shmControlHeader, controlEntry> page{control};
+		const auto numEntries{std::min<uint64_t>(page.header()._numEntries, page.endData() - page.data())};
+		for (uint64_t slot = 0; slot < numEntries; ++slot)
+			it->second[slot] = page.data()[slot]._id;
+		return it->second;
+	}
+
+	std::ostream& _stream;
+	std::map<uint64_t, std::map<uint64_t, std::string>> _names; // of the regions per pid
+	size_t _numEvents{0};
+};
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string.h>
+#include <unistd.h>
+
+#include "shmFile.h"
+#include "registry.h"
+
+namespace profiler
+{
+
+/*
+	a value that goes up and down, queue depth, connections: the last one, min, max
+	and optionally the time weighted mean, each value weighted by how long it was the last one.
+	_weightedSum covers [_firstNanos, _lastNanos] in steady clock nanos, readers add _last * (now - _lastNanos)
+	and divide by now - _firstNanos
+*/
+struct shmGaugeHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE0000000C; }
+public:
+	shmGaugeHeader() = default;
+	shmGaugeHeader(bool timeWeighted, const std::string& desc)
+	: _magic{magic()}, _timeWeighted{timeWeighted ? uint64_t{1} : 0}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+
+	double timeWeightedMean(uint64_t nowNanos) const
+	{
+		if (_numUpdates == 0 || nowNanos <= _firstNanos)
+			return static_cast<double>(_last);
+		const auto sum{_weightedSum + static_cast<double>(_last) * static_cast<double>(nowNanos - std::min(_lastNanos, nowNanos))};
+		return sum / static_cast<double>(nowNanos - _firstNanos);
+	}
+
+	uint64_t _magic{0};
+	int64_t _last{0};
+	int64_t _min{std::numeric_limits<int64_t>::max()};
+	int64_t _max{std::numeric_limits<int64_t>::min()};
+	uint64_t _numUpdates{0};
+	uint64_t _timeWeighted{0};
+	uint64_t _firstNanos{0};
+	uint64_t _lastNanos{0};
+	double _weightedSum{0};
+	char _description[128] = {'\0'};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmGaugeHeader& obj)
+{
+	stream << obj._description << " : _last: " << obj._last << ", _min: " << obj._min << ", _max: " << obj._max
+		<< ", _numUpdates: " << obj._numUpdates;
+	if (obj._timeWeighted)
+		stream << ", time weighted mean: " << obj.timeWeightedMean(obj._lastNanos);
+	return stream;
+}
+
+/*
+	updated by the thread that owns it, a few stores and a steady clock read when time weighted.
+	a shared gauge is one for the whole process, a producer adds +1 and its consumers -1 to the same value,
+	every update takes its lock
+*/
+struct gauge
+{
+	gauge(bool timeWeighted, const std::string& id, metricInstance cnt, const std::string& desc, bool shared = false)
+	: _shmGauge{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm", shmGaugeHeader{timeWeighted, desc}, 0}
+	, _control{cnt._control}
+	, _shared{shared}
+	{}
+
+	void set(int64_t value)
+	{
+		update([this, value](){
+			if (!_control.enabled([](const controlEntry&){}))
+				return;
+			record(value, _shmGauge.header()._timeWeighted ? nowNanos() : 0);
+		});
+	}
+
+	// the delta applies while the control page disables the gauge too, a depth kept by +1 and -1 doesn't drift.
+	// only the min, max, number of updates and time weighted mean wait for it to be enabled again
+	void add(int64_t delta)
+	{
+		update([this, delta](){
+			auto& header{_shmGauge.header()};
+			if (!_control.enabled([](const controlEntry&){}))
+			{
+				header._last += delta;
+				return;
+			}
+			record(header._last + delta, header._timeWeighted ? nowNanos() : 0);
+		});
+	}
+
+	void record(int64_t value, uint64_t nowNanos)
+	{
+		auto& header{_shmGauge.header()};
+		if (header._timeWeighted)
+		{
+			if (header._numUpdates == 0)
+				header._firstNanos = nowNanos;
+			else if (nowNanos > header._lastNanos)
+				header._weightedSum += static_cast<double>(header._last) * static_cast<double>(nowNanos - header._lastNanos);
+			header._lastNanos = std::max(header._lastNanos, nowNanos);
+		}
+		header._last = value;
+		header._min = std::min(header._min, value);
+		header._max = std::max(header._max, value);
+		++header._numUpdates;
+	}
+
+	static uint64_t nowNanos()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	template <typename update_t>
+	void update(update_t&& apply)
+	{
+		if (!_shared)
+			return apply();
+		std::lock_guard<std::mutex> l{_mtx};
+		apply();
+	}
+
+	shmFile<shmGaugeHeader, uint64_t> _shmGauge;
+	controlled _control;
+	const bool _shared;
+	std::mutex _mtx;
+};
+
+
+/*
+	a monotonic count sharded per thread, each thread adds to the _value of its own file shmFile_<id>_<pid>_<n>.shm
+	and readers sum the files of the id, see counterTotal. files of exited threads and processes keep their counts
+*/
+struct shmCounterHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE0000000D; }
+public:
+	shmCounterHeader() = default;
+	explicit shmCounterHeader(const std::string& desc)
+	: _magic{magic()}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+
+	uint64_t _magic{0};
+	uint64_t _value{0};
+	char _description[128] = {'\0'};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmCounterHeader& obj)
+{
+	stream << obj._description << " : _value: " << obj._value;
+	return stream;
+}
+
+struct counter
+{
+	counter(const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmCounter{fileName(id, static_cast<uint64_t>(::getpid()), cnt._number), shmCounterHeader{desc}, 0}
+	, _control{cnt._control}
+	{}
+
+	void add(uint64_t num = 1)
+	{
+		if (_control.enabled([](const controlEntry&){}))
+			_shmCounter.header()._value += num;
+	}
+
+	uint64_t value() const { return _shmCounter.header()._value; }
+
+	// the pid keeps processes writing to the same directory off each other's shards
+	static std::string fileName(const std::string& id, uint64_t pid, uint64_t number)
+	{
+		return "shmFile_" + id + "_" + std::to_string(pid) + "_" + std::to_string(number) + ".shm";
+	}
+
+	shmFile<shmCounterHeader, uint64_t> _shmCounter;
+	controlled _control;
+};
+
+// sum of the counters shmFile_<id>_<pid>_<n>.shm in dir, of all the threads of all the processes that wrote there
+inline uint64_t counterTotal(const std::filesystem::path& dir, const std::string& id)
+{
+	const auto prefix{"shmFile_" + id + "_"};
+	auto isNumber = [](const std::string& str){ return !str.empty() && str.find_first_not_of("0123456789") == std::string::npos; };
+	uint64_t total{0};
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator{dir, ec})
+	{
+		const auto filename{entry.path().filename().string()};
+		if (!entry.is_regular_file() || filename.rfind(prefix, 0) != 0 || entry.path().extension() != ".shm")
+			continue;
+		// <pid>_<n>, the shards of an id that extends this one have more parts
+		const auto shard{filename.substr(prefix.size(), filename.size() - prefix.size() - 4)};
+		const auto separator{shard.find('_')};
+		if (separator == std::string::npos || !isNumber(shard.substr(0, separator)) || !isNumber(shard.substr(separator + 1)))
+			continue;
+
+		const shmFile<shmCounterHeader, uint64_t> shm{entry.path()};
+		if (shm.header()._magic == shmCounterHeader::magic())
+			total += __atomic_load_n(&shm.header()._value, __ATOMIC_RELAXED);
+	}
+	return total;
+}
+
+}
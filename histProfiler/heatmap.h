@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string.h>
+
+#include "shmFile.h"
+#include "registry.h"
+
+namespace profiler
+{
+
+/*
+	how the latency distribution moves over time: a ring of _numBuckets rows indexed like rateCounter,
+	steady clock nanos / _nanosPerBucket % _numBuckets, each row a coarse latency histogram.
+	a row is [end of its interval in steady clock nanos, _numLatencyBuckets counts],
+	it is cleared when a sample of a newer interval lands on it, rows of skipped intervals keep their old end.
+	readers take the rows whose end is within _numBuckets intervals of the row at _currentIndex.
+	the writer stores the end after clearing the counts with release, a reader loads it first with acquire (rowEnd)
+*/
+struct shmHeatmapHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE0000000A; }
+public:
+	shmHeatmapHeader() = default;
+	shmHeatmapHeader(uint64_t nanosPerBucket, uint64_t numBuckets, uint64_t samplesPerBucket, uint64_t numLatencyBuckets, const std::string& desc)
+	: _magic{magic()}, _nanosPerBucket{nanosPerBucket}, _numBuckets{numBuckets}
+	, _samplesPerBucket{samplesPerBucket}, _numLatencyBuckets{numLatencyBuckets}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+
+	uint64_t rowSize() const { return _numLatencyBuckets + 1; }
+
+	// the end of a row's interval, a reader that sees a new end sees the row cleared for it
+	static uint64_t rowEnd(const uint64_t* row) { return __atomic_load_n(row, __ATOMIC_ACQUIRE); }
+
+	uint64_t _magic{0};
+	uint64_t _nanosPerBucket{1}; // of a row
+	uint64_t _numBuckets{0}; // rows
+	uint64_t _samplesPerBucket{1}; // of a latency bucket
+	uint64_t _numLatencyBuckets{0};
+	uint64_t _currentIndex{0}; // the row of the latest interval
+	uint64_t _overfows{0};
+	uint64_t _numSamples{0};
+	char _description[128] = {'\0'};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmHeatmapHeader& obj)
+{
+	stream << obj._description
+		<< " : _numBuckets: " << obj._numBuckets << ", _nanosPerBucket: " << obj._nanosPerBucket
+		<< ", _numLatencyBuckets: " << obj._numLatencyBuckets << ", _samplesPerBucket: " << obj._samplesPerBucket
+		<< ", _currentIndex: " << obj._currentIndex << ", _overfows: " << obj._overfows << ", _numSamples: " << obj._numSamples;
+	return stream;
+}
+
+struct timeHeatmap
+{
+	timeHeatmap(uint64_t nanosPerBucket, uint64_t numBuckets, uint64_t samplesPerBucket, uint64_t numLatencyBuckets,
+			const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmHeatmap{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				  shmHeatmapHeader{std::max<uint64_t>(nanosPerBucket, 1), std::max<uint64_t>(numBuckets, 1),
+								   std::max<uint64_t>(samplesPerBucket, 1), std::max<uint64_t>(numLatencyBuckets, 1), desc},
+				  std::max<uint64_t>(numBuckets, 1) * (std::max<uint64_t>(numLatencyBuckets, 1) + 1)}
+	, _control{cnt._control}
+	{}
+
+	// TimeHistBegin and TimeHistEnd work with the heatmap too
+	void begin()
+	{
+		_sampled = _control.enabled([](const controlEntry&){});
+		if (_sampled)
+			_begin = std::chrono::steady_clock::now();
+	}
+	void end(uint64_t /*tag*/ = 0)
+	{
+		if (!_sampled)
+			return;
+		const auto end{std::chrono::steady_clock::now()};
+		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(end - _begin).count()};
+		record(static_cast<uint64_t>(diffNanos), nanosOf(end));
+	}
+
+	void sample(uint64_t sample)
+	{
+		if (_control.enabled([](const controlEntry&){}))
+			record(sample, nanosOf(std::chrono::steady_clock::now()));
+	}
+
+	// the sample goes to the row of the interval nowNanos is in
+	void record(uint64_t sample, uint64_t nowNanos)
+	{
+		auto& header{_shmHeatmap.header()};
+
+		const auto interval{nowNanos / header._nanosPerBucket};
+		const auto index{interval % header._numBuckets};
+		auto* row{_shmHeatmap.data() + index * header.rowSize()};
+		const auto intervalEnd{(interval + 1) * header._nanosPerBucket};
+		if (row[0] != intervalEnd)
+		{
+			// the row held an older interval, the new end is published after the counts are cleared
+			memset(row + 1, 0, header._numLatencyBuckets * sizeof(uint64_t));
+			__atomic_store_n(&row[0], intervalEnd, __ATOMIC_RELEASE);
+			header._currentIndex = index;
+		}
+
+		const auto bucket{header._samplesPerBucket > 1 ? sample / header._samplesPerBucket : sample};
+		if (bucket < header._numLatencyBuckets - 1)
+		{
+			++row[1 + bucket];
+		}
+		else
+		{
+			++header._overfows;
+			++row[header._numLatencyBuckets];
+		}
+		++header._numSamples;
+	}
+
+	static uint64_t nanosOf(std::chrono::steady_clock::time_point tp)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count());
+	}
+
+	shmFile<shmHeatmapHeader, uint64_t> _shmHeatmap;
+	std::chrono::steady_clock::time_point _begin;
+	bool _sampled{false};
+	controlled _control;
+};
+
+}
@@ -4,19 +4,139 @@
 #include <sstream>
 #include <string>
 #include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+#include <vector>
 
 #include "shmFile.h"
+#include "registry.h"
+#include "latencyStamp.h"
+#include "overhead.h"
+#include "eventRing.h"
 
 namespace profiler
 {
 
+/*
+	a sample kept for tail investigation, with the context it was recorded in
+*/
+struct exemplar
+{
+	uint64_t _value{0};
+	uint64_t _timestampNanos{0}; // system_clock, to correlate with logs
+	uint64_t _threadId{0};
+	uint64_t _tag{0}; // user supplied, i.e. request id
+};
+
+constexpr size_t maxExemplars{32};
+
+/*
+	the K largest samples, kept as a min-heap inside the header page.
+	_entries[0] is the smallest kept sample, a new sample is a candidate only
+	when it is above _threshold, so the common path is a single compare.
+	_capacity 0 disables it - _threshold stays at max and nothing gets in.
+*/
+struct shmExemplars
+{
+	shmExemplars() = default;
+	explicit shmExemplars(size_t capacity)
+	: _capacity{std::min(capacity, maxExemplars)}, _threshold{_capacity > 0 ? 0 : std::numeric_limits<uint64_t>::max()}
+	{}
+
+	bool candidate(uint64_t value) const { return value > _threshold; }
+
+	void insert(uint64_t value, uint64_t threadId, uint64_t tag)
+	{
+		const auto nowNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()};
+		insert(exemplar{value, static_cast<uint64_t>(nowNanos), threadId, tag});
+	}
+
+	void insert(const exemplar& ex)
+	{
+		const auto value{ex._value};
+		if (_size < _capacity)
+		{
+			// sift up
+			auto pos{_size++};
+			while (pos > 0)
+			{
+				const auto parent{(pos - 1) / 2};
+				if (_entries[parent]._value <= value)
+					break;
+				_entries[pos] = _entries[parent];
+				pos = parent;
+			}
+			_entries[pos] = ex;
+
+			if (_size == _capacity)
+				_threshold = _entries[0]._value;
+			return;
+		}
+
+		// replace the smallest and sift down
+		uint64_t pos{0};
+		while (true)
+		{
+			const auto left{2 * pos + 1};
+			if (left >= _size)
+				break;
+			const auto right{left + 1};
+			const auto child{right < _size && _entries[right]._value < _entries[left]._value ? right : left};
+			if (_entries[child]._value >= value)
+				break;
+			_entries[pos] = _entries[child];
+			pos = child;
+		}
+		_entries[pos] = ex;
+		_threshold = _entries[0]._value;
+	}
+
+	// keeps the largest of both, the exemplars of an exited thread into the process aggregate
+	void merge(const shmExemplars& other)
+	{
+		for (uint64_t i = 0; i < std::min(other._size, other._capacity); ++i)
+		{
+			if (candidate(other._entries[i]._value))
+				insert(other._entries[i]);
+		}
+	}
+
+	void clear()
+	{
+		_size = 0;
+		_threshold = _capacity > 0 ? 0 : std::numeric_limits<uint64_t>::max();
+	}
+
+	uint64_t _capacity{0};
+	uint64_t _size{0};
+	uint64_t _threshold{std::numeric_limits<uint64_t>::max()};
+	exemplar _entries[maxExemplars];
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmExemplars& obj)
+{
+	// largest first
+	std::vector<exemplar> sorted{obj._entries, obj._entries + std::min(obj._size, obj._capacity)};
+	std::sort(sorted.begin(), sorted.end(), [](const auto& l, const auto& r){ return l._value > r._value; });
+	for (const auto& ex : sorted)
+	{
+		stream << std::endl << "\t" << ex._value << " at: " << ex._timestampNanos
+			<< ", thread: " << ex._threadId << ", tag: " << ex._tag;
+	}
+	return stream;
+}
+
 struct shmHistHeader
 {
 	static constexpr uint64_t magic() { return 0x0BADBABE00000001; }
 public:
 	shmHistHeader() = default;
-	shmHistHeader(size_t numBuckets, const std::string& aAxisDesc = "", const std::string& desc = "")
-	: _magic{magic()}, _numBuckets{numBuckets}
+	shmHistHeader(size_t numBuckets, const std::string& aAxisDesc = "", const std::string& desc = "", size_t numExemplars = 0)
+	: _magic{magic()}, _numBuckets{numBuckets}, _exemplars{numExemplars}
 	{
 		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
 		strncpy(_XAxisDescription, aAxisDesc.c_str(), sizeof(_XAxisDescription) - 1);
@@ -26,6 +146,7 @@ public:
 		_magic = _numBuckets = _maxSample = _minSample = _overfows = _sum = _numSamples = 0;
 		_description[0] = '\0';
 		_XAxisDescription[0] = '\0';
+		_exemplars.clear();
 	}
 	uint64_t _magic{0};
 	uint64_t _numBuckets{0};
@@ -36,32 +157,41 @@ public:
 	uint64_t _numSamples{ 0 };
 	char _description[128] = {'\0'};
 	char _XAxisDescription[128] = {'\0'};
+	shmExemplars _exemplars;
 };
 
-std::ostream& operator<<(std::ostream& stream, const shmHistHeader& obj)
+inline std::ostream& operator<<(std::ostream& stream, const shmHistHeader& obj)
 {
 	auto mean{obj._numSamples > 0 ? obj._sum / obj._numSamples : 0};
 	stream << obj._description
 		<< " : _numBuckets: " << obj._numBuckets
 		<< ", _maxSample: " << obj._maxSample << ", _minSample: " << obj._minSample
-        << ", _overfows: " << obj._overfows << ", mean: " << mean << ", _numSamples: " << obj._numSamples;
+        << ", _overfows: " << obj._overfows << ", mean: " << mean << ", _numSamples: " << obj._numSamples
+		<< obj._exemplars;
 	return stream;
 }
 
 struct histogram
 {
-	histogram(uint64_t numBuckets, const std::string& id, size_t cnt_, 
-			  const std::string& xAxisDesc, const std::string& desc)
-	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt_) + ".shm", 
-		  		shmHistHeader{numBuckets, xAxisDesc, desc},
+	histogram(uint64_t numBuckets, const std::string& id, metricInstance cnt_, 
+			  const std::string& xAxisDesc, const std::string& desc, size_t numExemplars = 0)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt_._number) + ".shm", 
+		  		shmHistHeader{numBuckets, xAxisDesc, desc, numExemplars},
 				numBuckets}
+	, _control{cnt_._control}
 	{}
 
-	void sample(uint64_t sample)
+	void sample(uint64_t sample, uint64_t tag = 0)
 	{
+		if (!_control.enabled([](const controlEntry&){}))
+			return;
+
 		auto& header{_shmHist.header()};
 		auto* data{_shmHist.data()};
 
+		if (header._exemplars.candidate(sample))
+			header._exemplars.insert(sample, _threadId, tag);
+
 		if (sample > header._maxSample)
 			header._maxSample = sample;
 		if (sample < header._minSample)
@@ -84,6 +214,8 @@ struct histogram
 	}
 
 	shmFile<shmHistHeader, uint64_t> _shmHist;
+	uint64_t _threadId{threadId()};
+	controlled _control;
 };
 
 
@@ -92,14 +224,30 @@ struct shmTimeHistHeader
 	static constexpr uint64_t magic() { return 0x0BADBABE00000002; }
 public:
 	shmTimeHistHeader() = default;
-	shmTimeHistHeader(size_t samplesPerBucket, size_t numBuckets, const std::string& desc)
-	: _magic{magic()}, _samplesPerBucket{samplesPerBucket}, _numBuckets{numBuckets}
+	shmTimeHistHeader(size_t samplesPerBucket, size_t numBuckets, const std::string& desc, size_t numExemplars = 0, 
+					  uint64_t expectedIntervalNanos = 0)
+	: _magic{magic()}, _samplesPerBucket{samplesPerBucket}, _numBuckets{numBuckets}, _exemplars{numExemplars},
+	  _expectedIntervalNanos{expectedIntervalNanos}
 	{
 		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
 	}
 	void clear()
 	{
 		_magic = _samplesPerBucket = _numBuckets = _maxSample = _minSample = _overfows = _sum = _numSamples = 0;
+		_exemplars.clear();
+		_expectedIntervalNanos = _correctedOverflows = _correctedSum = _correctedNumSamples = 0;
+		_samplingRatio = _samplingBudgetNanos = _samplingCostNanos = _numCalls = 0;
+		_clockSkews = _maxClockSkewNanos = 0;
+		_overhead = shmOverhead{};
+	}
+	// drops what was recorded, keeps the configuration
+	void resetSamples()
+	{
+		_maxSample = _overfows = _sum = _numSamples = 0;
+		_minSample = std::numeric_limits<uint64_t>::max();
+		_exemplars.clear();
+		_correctedOverflows = _correctedSum = _correctedNumSamples = 0;
+		_numCalls = _clockSkews = _maxClockSkewNanos = 0;
 	}
 	uint64_t _magic{0};
 	uint64_t _samplesPerBucket{1};
@@ -110,16 +258,61 @@ public:
 	uint64_t _sum{ 0 };
 	uint64_t _numSamples{ 0 };
 	char _description[128] = {'\0'};
-	
+	shmExemplars _exemplars; // raw samples in nanos
+
+	/*
+		coordinated omission correction, 0 - disabled.
+		when enabled the data holds 2 arrays of _numBuckets:
+		[0, _numBuckets) - raw, [_numBuckets, 2 * _numBuckets) - corrected
+	*/
+	uint64_t _expectedIntervalNanos{0};
+	uint64_t _correctedOverflows{0};
+	uint64_t _correctedSum{0};
+	uint64_t _correctedNumSamples{0};
+
+	/*
+		1 in _samplingRatio regions is measured, readers scale the counts by _numCalls / _numSamples.
+		with a budget the ratio is recomputed every second so that
+		calls per second * _samplingCostNanos / _samplingRatio stays within the budget
+	*/
+	uint64_t _samplingRatio{1};
+	uint64_t _samplingBudgetNanos{0}; // per second, 0 - fixed ratio
+	uint64_t _samplingCostNanos{0}; // of a measured region, calibrated when adaptive
+	uint64_t _numCalls{0};
+
+	// latency tokens consumed before they were produced, the clocks of the 2 sides are skewed
+	uint64_t _clockSkews{0};
+	uint64_t _maxClockSkewNanos{0};
+
+	// of the clock the regions are measured with, calibrated at startup
+	shmOverhead _overhead;
 };
 
-std::ostream& operator<<(std::ostream& stream, const shmTimeHistHeader& obj)
+inline std::ostream& operator<<(std::ostream& stream, const shmTimeHistHeader& obj)
 {
 	auto mean{obj._numSamples > 0 ? obj._sum / obj._numSamples : 0};
 	stream << obj._description
 		<< " : _numBuckets: " << obj._numBuckets << ", _samplesPerBucket: " << obj._samplesPerBucket
 		<< ", _maxSample: " << obj._maxSample << ", _minSample: " << obj._minSample
         << ", _overfows: " << obj._overfows << ", mean: " << mean << ", _numSamples: " << obj._numSamples;
+	if (obj._expectedIntervalNanos > 0)
+	{
+		auto correctedMean{obj._correctedNumSamples > 0 ? obj._correctedSum / obj._correctedNumSamples : 0};
+		stream << ", _expectedIntervalNanos: " << obj._expectedIntervalNanos
+			<< ", _correctedOverflows: " << obj._correctedOverflows << ", corrected mean: " << correctedMean
+			<< ", _correctedNumSamples: " << obj._correctedNumSamples;
+	}
+	if (obj._samplingRatio > 1 || obj._samplingBudgetNanos > 0)
+	{
+		stream << ", _samplingRatio: " << obj._samplingRatio << ", _numCalls: " << obj._numCalls
+			<< ", _samplingBudgetNanos: " << obj._samplingBudgetNanos << ", _samplingCostNanos: " << obj._samplingCostNanos;
+	}
+	if (obj._clockSkews > 0)
+	{
+		stream << ", _clockSkews: " << obj._clockSkews << ", _maxClockSkewNanos: " << obj._maxClockSkewNanos;
+	}
+	stream << std::endl << "\t" << obj._overhead;
+	stream << obj._exemplars;
 	return stream;
 }
 
@@ -128,34 +321,134 @@ struct timeHistogram
 {
 	// std::to_string(gettid())
 	timeHistogram(uint64_t numSamplesPerBucket, uint64_t numBuckets,
-			const std::string& id, size_t cnt_, const std::string& desc)
-	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt_) + ".shm", 
-		  		shmTimeHistHeader{numSamplesPerBucket, numBuckets, desc},
-				numBuckets}
-	{}
+			const std::string& id, metricInstance cnt_, const std::string& desc, size_t numExemplars = 0,
+			uint64_t expectedIntervalNanos = 0, uint64_t samplingRatio = 1, uint64_t samplingBudgetNanos = 0,
+			bool subtractOverhead = false)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt_._number) + ".shm", 
+		  		shmTimeHistHeader{numSamplesPerBucket, numBuckets, desc, numExemplars, expectedIntervalNanos},
+				expectedIntervalNanos > 0 ? 2 * numBuckets : numBuckets}
+	, _control{cnt_._control}
+	, _configuredSamplesPerBucket{numSamplesPerBucket}
+	, _configuredSamplingRatio{std::max<uint64_t>(samplingRatio, 1)}
+	, _configuredSamplingBudgetNanos{samplingBudgetNanos}
+	{
+		// calibrates now for consume(), not on the first message
+		tscCalibration::instance();
+		_shmHist.header()._overhead = regionOverhead();
+		_shmHist.header()._overhead._subtracted = subtractOverhead;
+
+		if (samplingBudgetNanos > 0)
+		{
+			// cost of a measured region, then start over with a clean histogram
+			constexpr size_t calibrationRounds{64};
+			const auto calibrationBegin{std::chrono::system_clock::now()};
+			for (size_t i = 0; i < calibrationRounds; ++i)
+			{
+				_sampled = true;
+				_begin = std::chrono::system_clock::now();
+				end();
+			}
+			const auto calibrationNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now() - calibrationBegin).count()};
+
+			resetSamples();
+			_shmHist.header()._samplingCostNanos = std::max<uint64_t>(calibrationNanos / calibrationRounds, 1);
+		}
+
+		auto& header{_shmHist.header()};
+		header._samplingRatio = _configuredSamplingRatio;
+		header._samplingBudgetNanos = samplingBudgetNanos;
+		restartWindow();
+
+		// after the calibration, its regions are not the application's
+		_events = eventRing::local();
+		_region = eventRing::regionOf(_control.entry());
+	}
 
+	/*
+		when the region is not sampled or disabled from the control page
+		begin() and end() don't read the clock
+	*/
 	void begin()
 	{
+		_sampled = false;
+		if (!_control.enabled([this](const controlEntry& entry){ applyControl(entry); }))
+			return;
+
+		auto& header{_shmHist.header()};
+		if (--_countdown != 0)
+		{
+			++header._numCalls;
+			return;
+		}
+		_sampled = true;
 		_begin = std::chrono::system_clock::now();
+
+		if (header._samplingBudgetNanos > 0)
+			adapt();
+		_countdown = header._samplingRatio;
 	}
-	void end()
+	void end(uint64_t tag = 0)
 	{
+		if (!_sampled)
+			return;
+
 		const auto end{std::chrono::system_clock::now()};
 		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(end - _begin)};
-		sample(diffNanos.count());
+		record(measured(diffNanos.count()), tag);
+
+		if (_events)
+		{
+			const auto beginNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(_begin.time_since_epoch())};
+			_events->write(_region, static_cast<uint64_t>(beginNanos.count()), static_cast<uint64_t>(diffNanos.count()));
+		}
 	}
 
-	void sample(std::chrono::time_point<std::chrono::system_clock> begin, std::chrono::time_point<std::chrono::system_clock> end)
+	void sample(std::chrono::time_point<std::chrono::system_clock> begin, std::chrono::time_point<std::chrono::system_clock> end, uint64_t tag = 0)
 	{
+		// the caller's own clock reads, they don't include the overhead of begin() and end()
 		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)};
-		sample(diffNanos.count());
+		sample(diffNanos.count(), tag);
 	}
 
-	void sample(uint64_t sample)
+	// a region measured by begin() and end(), optionally without the median cost of an empty one
+	uint64_t measured(uint64_t nanos) const
+	{
+		const auto& overhead{_shmHist.header()._overhead};
+		return overhead._subtracted ? withoutOverhead(nanos, overhead) : nanos;
+	}
+
+	void sample(uint64_t sample, uint64_t tag = 0)
+	{
+		if (_control.enabled([this](const controlEntry& entry){ applyControl(entry); }))
+			record(sample, tag);
+	}
+
+	// latency of a message from the token its producer stamped
+	void consume(latencyToken token, uint64_t tag = 0)
+	{
+		if (!_control.enabled([this](const controlEntry& entry){ applyControl(entry); }))
+			return;
+
+		const auto nanos{token.elapsedNanos()};
+		if (nanos < 0)
+		{
+			auto& header{_shmHist.header()};
+			++header._clockSkews;
+			header._maxClockSkewNanos = std::max(header._maxClockSkewNanos, static_cast<uint64_t>(-nanos));
+			record(0, tag);
+			return;
+		}
+		record(static_cast<uint64_t>(nanos), tag);
+	}
+
+	void record(uint64_t sample, uint64_t tag)
 	{
 		auto& header{_shmHist.header()};
 		auto* data{_shmHist.data()};
 
+		if (header._exemplars.candidate(sample))
+			header._exemplars.insert(sample, _threadId, tag);
+
 		if (sample > header._maxSample)
 			header._maxSample = sample;
 		if (sample < header._minSample)
@@ -174,15 +467,202 @@ struct timeHistogram
 
 		header._sum += bucket;
 		++header._numSamples;
+		++header._numCalls;
+
+		if (header._expectedIntervalNanos > 0)
+			sampleCorrected(sample);
 
 		_shmHist.sync();
 	}
 
+	// settings written by the operator to the control page, 0 - back to the call site configuration
+	void applyControl(const controlEntry& entry)
+	{
+		auto& header{_shmHist.header()};
+
+		if (entry._samplingRatio > 0)
+		{
+			// the operator overrides adaptive sampling
+			if (entry._samplingRatio != header._samplingRatio || header._samplingBudgetNanos != 0)
+			{
+				header._samplingRatio = entry._samplingRatio;
+				header._samplingBudgetNanos = 0;
+				_countdown = 1;
+			}
+		}
+		else if (header._samplingBudgetNanos != _configuredSamplingBudgetNanos
+				 || (_configuredSamplingBudgetNanos == 0 && header._samplingRatio != _configuredSamplingRatio))
+		{
+			// back to the configuration, an adaptive ratio starts over from the configured one
+			header._samplingRatio = _configuredSamplingRatio;
+			header._samplingBudgetNanos = _configuredSamplingBudgetNanos;
+			_countdown = 1;
+			restartWindow();
+		}
+
+		// buckets of different resolutions don't add up, start over
+		const auto perBucket{entry._samplesPerBucket > 0 ? entry._samplesPerBucket : _configuredSamplesPerBucket};
+		if (perBucket != header._samplesPerBucket)
+		{
+			resetSamples();
+			header._samplesPerBucket = perBucket;
+		}
+	}
+
+	void resetSamples()
+	{
+		_shmHist.header().resetSamples();
+		memset(_shmHist.dataAs<void*>(), 0, (_shmHist.endData() - _shmHist.data()) * sizeof(uint64_t));
+		// _numCalls starts from 0 again
+		restartWindow();
+	}
+
+	/*
+		records the sample and back fills the samples that were not taken while it was running,
+		like HdrHistogram: sample - interval, sample - 2 * interval, ... while >= interval.
+		the missing samples form an arithmetic sequence, so each bucket gets the count
+		of its members at once, O(buckets touched) and not O(missing samples)
+	*/
+	void sampleCorrected(uint64_t sample)
+	{
+		auto& header{_shmHist.header()};
+		auto* corrected{_shmHist.data() + header._numBuckets};
+		const auto interval{header._expectedIntervalNanos};
+		const auto perBucket{std::max<uint64_t>(header._samplesPerBucket, 1)};
+		const auto lastBucket{header._numBuckets - 1};
+
+		auto add = [&](uint64_t bucket, uint64_t cnt){
+			if (bucket < lastBucket)
+			{
+				corrected[bucket] += cnt;
+			}
+			else
+			{
+				header._correctedOverflows += cnt;
+				corrected[lastBucket] += cnt;
+				bucket = lastBucket;
+			}
+			header._correctedSum += bucket * cnt;
+			header._correctedNumSamples += cnt;
+		};
+
+		add(sample / perBucket, 1);
+
+		if (sample < 2 * interval)
+			return;
+
+		// missing samples are sample - k * interval for k in [1, numMissing]
+		const auto numMissing{sample / interval - 1};
+		uint64_t k{1};
+
+		// everything at or above the last bucket goes to the overflow bucket in one shot
+		const auto overflowFrom{lastBucket * perBucket};
+		if (sample - interval >= overflowFrom)
+		{
+			const auto kEnd{std::min(numMissing, (sample - overflowFrom) / interval)};
+			add(lastBucket, kEnd);
+			k = kEnd + 1;
+		}
+
+		while (k <= numMissing)
+		{
+			const auto bucket{(sample - k * interval) / perBucket};
+			// the largest k which is still in this bucket
+			const auto kEnd{std::min(numMissing, (sample - bucket * perBucket) / interval)};
+			add(bucket, kEnd - k + 1);
+			k = kEnd + 1;
+		}
+	}
+
+	// adapt() counts the calls from now on
+	void restartWindow()
+	{
+		_windowBegin = std::chrono::system_clock::now();
+		_windowCalls = _shmHist.header()._numCalls;
+	}
+
+	// once per second, sets the ratio that keeps the measuring cost within the budget
+	void adapt()
+	{
+		auto& header{_shmHist.header()};
+		const auto elapsedNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(_begin - _windowBegin).count()};
+		if (elapsedNanos < 1'000'000'000)
+			return;
+
+		// _numCalls may have been zeroed by a reader, not by resetSamples
+		const auto calls{header._numCalls >= _windowCalls ? header._numCalls - _windowCalls : header._numCalls};
+		const auto costPerSecond{static_cast<double>(calls) * header._samplingCostNanos * 1'000'000'000 / elapsedNanos};
+		header._samplingRatio = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(costPerSecond / header._samplingBudgetNanos)), 1);
+
+		_windowBegin = _begin;
+		_windowCalls = header._numCalls;
+	}
+
+	/*
+		what an empty begin() and end() measure, the rest of begin() after its clock read and the clock read of end().
+		the same code for every time histogram, so the first one calibrates it once per process.
+		when the control page disables it begin() doesn't read the clock, it's 2 bare clock reads then
+	*/
+	shmOverhead regionOverhead()
+	{
+		static const auto overhead{calibrateOverhead(clockSource::systemClock, [this](){
+			begin();
+			const auto end{std::chrono::system_clock::now()};
+			if (!_sampled)
+				return emptyRegionNanos<std::chrono::system_clock>();
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - _begin).count());
+		})};
+		_sampled = false;
+		return overhead;
+	}
+
 	std::chrono::time_point<std::chrono::system_clock> _begin;
 	shmFile<shmTimeHistHeader, uint64_t> _shmHist;
+	uint64_t _threadId{threadId()};
+
+	uint64_t _countdown{1};
+	bool _sampled{false};
+	std::chrono::time_point<std::chrono::system_clock> _windowBegin;
+	uint64_t _windowCalls{0};
+
+	controlled _control;
+	uint64_t _configuredSamplesPerBucket{1};
+	uint64_t _configuredSamplingRatio{1};
+	uint64_t _configuredSamplingBudgetNanos{0};
+
+	// the thread's ring of the last regions, when the process configured one before the histogram was created
+	eventRing* _events{nullptr};
+	uint64_t _region{eventRecord::noRegion()};
 };
 
 
+constexpr size_t maxCoarserRates{3};
+
+// a ring of counts per _nanosPerBucket, its data starts at _offset
+struct shmRateResolution
+{
+	uint64_t _nanosPerBucket{0};
+	uint64_t _numBuckets{0};
+	uint64_t _offset{0};
+	uint64_t _lastEpoch{0}; // steady clock nanos / _nanosPerBucket of the last sample
+	uint64_t _currentIndex{0};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmRateResolution& obj)
+{
+	stream << "_nanosPerBucket: " << obj._nanosPerBucket << ", _numBuckets: " << obj._numBuckets
+		<< ", _currentIndex: " << obj._currentIndex << ", _lastEpoch: " << obj._lastEpoch;
+	return stream;
+}
+
+/*
+	the data holds the ring of _numBuckets counts, then the ring of every coarser resolution.
+	bucket i of a ring counts the epoch e, steady clock nanos / _nanosPerBucket, with e % _numBuckets == i.
+	buckets of the epochs between 2 samples are zeroed by the later one, so after an idle period
+	the ring holds only what was counted within _numBuckets epochs of _lastEpoch,
+	readers that see _lastEpoch far behind their own CLOCK_MONOTONIC know the thread went idle.
+	_ewmaPerSecond - events per second of the completed epochs, alpha = 1 - e^(-1 / _numBuckets)
+*/
 struct shmRateHeader
 {
 	static constexpr uint64_t magic() { return 0x0BADBABE00000003; }
@@ -190,6 +670,7 @@ public:
 	shmRateHeader() = default;
 	shmRateHeader(size_t nanosPerBucket, size_t numBuckets, const std::string& desc)
 	: _magic{magic()}, _nanosPerBucket{nanosPerBucket}, _numBuckets{numBuckets}
+	, _ewmaAlpha{1 - std::exp(-1.0 / static_cast<double>(std::max<size_t>(numBuckets, 1)))}
 	{
 		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
 	}
@@ -199,42 +680,127 @@ public:
 	uint64_t _numBuckets{0};
 	uint64_t _currentIndex{0};
 	char _description[128] = {'\0'};
+	uint64_t _lastEpoch{0};
+	double _ewmaPerSecond{0};
+	double _ewmaAlpha{0};
+	uint64_t _numCoarser{0};
+	shmRateResolution _coarser[maxCoarserRates];
 };
 
-std::ostream& operator<<(std::ostream& stream, const shmRateHeader& obj)
+inline std::ostream& operator<<(std::ostream& stream, const shmRateHeader& obj)
 {
 	stream << obj._description
-		<< " : _numBuckets: " << obj._numBuckets << ", _currentIndex: " << obj._currentIndex << ", _nanosPerBucket: " << obj._nanosPerBucket;
+		<< " : _numBuckets: " << obj._numBuckets << ", _currentIndex: " << obj._currentIndex << ", _nanosPerBucket: " << obj._nanosPerBucket
+		<< ", _lastEpoch: " << obj._lastEpoch << ", _ewmaPerSecond: " << obj._ewmaPerSecond;
+	for (uint64_t i = 0; i < obj._numCoarser; ++i)
+		stream << std::endl << "\t" << obj._coarser[i];
 	return stream;
 }
 
+// zeroes the buckets of the epochs after lastEpoch up to epoch, at most a lap
+inline void advanceRing(uint64_t* ring, uint64_t numBuckets, uint64_t& lastEpoch, uint64_t epoch)
+{
+	const auto gap{std::min(epoch - lastEpoch, numBuckets)};
+	for (auto e = epoch - gap + 1; e <= epoch; ++e)
+		ring[e % numBuckets] = 0;
+	lastEpoch = epoch;
+}
+
 struct rateCounter
 {
+	/*
+		coarser - {nanosPerBucket, numBuckets} of the rings kept besides the first one, up to maxCoarserRates,
+		their nanosPerBucket are multiples of the first one
+	*/
 	rateCounter(uint64_t nanosPerBucket, uint64_t numBuckets,
-			const std::string& id, size_t cnt, const std::string& desc)
-			:_shmRate{"shmFile_" + id + "_" + std::to_string(cnt) + ".shm",
+			const std::string& id, metricInstance cnt, const std::string& desc,
+			std::initializer_list<std::pair<uint64_t, uint64_t>> coarser = {})
+			:_shmRate{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
 					  shmRateHeader{nanosPerBucket, numBuckets, desc}, 
-					  numBuckets}
-			{}
+					  dataSize(nanosPerBucket, numBuckets, coarser)}
+			, _control{cnt._control}
+			{
+				auto& header{_shmRate.header()};
+				auto offset{numBuckets};
+				for (const auto& [nanos, num] : coarser)
+				{
+					auto& resolution{header._coarser[header._numCoarser++]};
+					resolution._nanosPerBucket = nanos;
+					resolution._numBuckets = num;
+					resolution._offset = offset;
+					offset += num;
+				}
+			}
+
+	static uint64_t dataSize(uint64_t nanosPerBucket, uint64_t numBuckets, std::initializer_list<std::pair<uint64_t, uint64_t>> coarser)
+	{
+		if (coarser.size() > maxCoarserRates)
+			Throw(std::runtime_error) << "too many rate resolutions: " << coarser.size() << ", max: " << maxCoarserRates << End;
+		auto size{numBuckets};
+		for (const auto& [nanos, num] : coarser)
+		{
+			if (nanos == 0 || nanos % nanosPerBucket != 0 || num == 0)
+				Throw(std::runtime_error) << "a coarser rate resolution must be a multiple of " << nanosPerBucket
+										  << " nanos per bucket, got: " << nanos << " with " << num << " buckets" << End;
+			size += num;
+		}
+		return size;
+	}
 
 	void sample(size_t num = 1)
+	{
+		if (!_control.enabled([](const controlEntry&){}))
+			return;
+
+		record(num, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()));
+	}
+
+	// counts num at the steady clock nanos
+	void record(size_t num, uint64_t nanos)
 	{
 		auto& header{_shmRate.header()};
 		auto* data{_shmRate.data()};
 
-		const auto nanos{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()};
-		const auto index{static_cast<size_t>((nanos / header._nanosPerBucket) % header._numBuckets)};
-		data[index] += num;
+		const auto epoch{nanos / header._nanosPerBucket};
+		// the coarser epochs change only with the first one
+		if (epoch != header._lastEpoch)
+			rotate(nanos, epoch);
+
+		data[header._currentIndex] += num;
+		for (uint64_t i = 0; i < header._numCoarser; ++i)
+			data[header._coarser[i]._offset + header._coarser[i]._currentIndex] += num;
+	}
+
+	void rotate(uint64_t nanos, uint64_t epoch)
+	{
+		auto& header{_shmRate.header()};
+		auto* data{_shmRate.data()};
+
+		if (header._lastEpoch != 0)
+		{
+			// the epoch that ended, then the idle ones
+			const auto perSecond{static_cast<double>(data[header._currentIndex]) * 1e9 / static_cast<double>(header._nanosPerBucket)};
+			header._ewmaPerSecond += header._ewmaAlpha * (perSecond - header._ewmaPerSecond);
+			const auto idle{std::min<uint64_t>(epoch - header._lastEpoch - 1, 64 * header._numBuckets)};
+			if (idle > 0)
+				header._ewmaPerSecond *= std::pow(1 - header._ewmaAlpha, static_cast<double>(idle));
+		}
+		advanceRing(data, header._numBuckets, header._lastEpoch, epoch);
+		header._currentIndex = epoch % header._numBuckets;
 
-		if (header._currentIndex != index)
+		for (uint64_t i = 0; i < header._numCoarser; ++i)
 		{
-			const auto nextIndexIndex{(index + 1) % header._numBuckets};
-			data[nextIndexIndex] = 0;
-			header._currentIndex = index;
+			auto& resolution{header._coarser[i]};
+			const auto coarserEpoch{nanos / resolution._nanosPerBucket};
+			if (coarserEpoch == resolution._lastEpoch)
+				continue;
+			advanceRing(data + resolution._offset, resolution._numBuckets, resolution._lastEpoch, coarserEpoch);
+			resolution._currentIndex = coarserEpoch % resolution._numBuckets;
 		}
 	}
 
 	shmFile<shmRateHeader, uint64_t> _shmRate;
+	controlled _control;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string.h>
+
+#include "shmFile.h"
+#include "registry.h"
+
+namespace profiler
+{
+
+enum class axisScale : uint64_t
+{
+	linear,
+	logLinear,
+};
+
+/*
+	HdrHistogram like buckets of a number of units: below 2^subBucketBits a bucket each,
+	above that every power of 2 is split into 2^subBucketBits buckets.
+	the group is 0 for the linear part, which makes both parts the same formula and the only branch a cmov
+*/
+inline uint64_t logLinearBucket(uint64_t units, uint64_t subBucketBits)
+{
+	const auto msb{static_cast<uint64_t>(63 - __builtin_clzll(units | 1))};
+	const auto group{msb > subBucketBits ? msb - subBucketBits : 0};
+	return (group << subBucketBits) + (units >> group);
+}
+
+// the smallest number of units of a bucket
+inline uint64_t logLinearLowerBound(uint64_t bucket, uint64_t subBucketBits)
+{
+	const auto subBuckets{uint64_t{1} << subBucketBits};
+	if (bucket < subBuckets)
+		return bucket;
+	const auto group{(bucket - subBuckets) / subBuckets};
+	const auto sub{(bucket - subBuckets) % subBuckets};
+	return (subBuckets + sub) << group;
+}
+
+/*
+	maps a value to a bucket, the value is divided by _unitsPerBucket first.
+	linear - one bucket per unit.
+	logLinear - logLinearBucket of the units, the relative error is at most 1 / 2^_subBucketBits at any magnitude.
+	the last bucket collects everything above the range
+*/
+struct shmAxis
+{
+	uint64_t index(uint64_t value) const
+	{
+		const auto units{_unitsPerBucket > 1 ? value / _unitsPerBucket : value};
+		const auto bucket{static_cast<axisScale>(_scale) == axisScale::logLinear ? logLinearBucket(units, _subBucketBits) : units};
+		return bucket < _numBuckets - 1 ? bucket : _numBuckets - 1;
+	}
+
+	// the smallest value of a bucket, for readers
+	uint64_t lowerBound(uint64_t bucket) const
+	{
+		if (static_cast<axisScale>(_scale) == axisScale::linear)
+			return bucket * _unitsPerBucket;
+		return logLinearLowerBound(bucket, _subBucketBits) * _unitsPerBucket;
+	}
+
+	uint64_t _scale{0};
+	uint64_t _unitsPerBucket{1};
+	uint64_t _subBucketBits{0};
+	uint64_t _numBuckets{1};
+	uint64_t _overfows{0};
+	char _description[64] = {'\0'};
+};
+
+inline shmAxis linearAxis(uint64_t unitsPerBucket, uint64_t numBuckets, const std::string& desc)
+{
+	shmAxis axis;
+	axis._scale = static_cast<uint64_t>(axisScale::linear);
+	axis._unitsPerBucket = std::max<uint64_t>(unitsPerBucket, 1);
+	axis._numBuckets = std::max<uint64_t>(numBuckets, 2);
+	strncpy(axis._description, desc.c_str(), sizeof(axis._description) - 1);
+	return axis;
+}
+
+// covers units up to 2^(subBucketBits + numGroups), with (numGroups + 1) * 2^subBucketBits buckets
+inline shmAxis logLinearAxis(uint64_t unitsPerBucket, uint64_t subBucketBits, uint64_t numGroups, const std::string& desc)
+{
+	shmAxis axis;
+	axis._scale = static_cast<uint64_t>(axisScale::logLinear);
+	axis._unitsPerBucket = std::max<uint64_t>(unitsPerBucket, 1);
+	axis._subBucketBits = subBucketBits;
+	axis._numBuckets = ((numGroups + 1) << subBucketBits) + 1; // + the overflow bucket
+	strncpy(axis._description, desc.c_str(), sizeof(axis._description) - 1);
+	return axis;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const shmAxis& obj)
+{
+	stream << obj._description << (static_cast<axisScale>(obj._scale) == axisScale::linear ? " linear" : " log linear")
+		<< ", _unitsPerBucket: " << obj._unitsPerBucket << ", _subBucketBits: " << obj._subBucketBits
+		<< ", _numBuckets: " << obj._numBuckets << ", _overfows: " << obj._overfows;
+	return stream;
+}
+
+/*
+	data is a matrix of _x._numBuckets rows by _y._numBuckets columns,
+	a row is the distribution of y for one x bucket, e.g. latency for a payload size.
+	the memory is _x._numBuckets * _y._numBuckets counters, fixed by the axes
+*/
+struct shmHist2DHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE00000008; }
+public:
+	shmHist2DHeader() = default;
+	shmHist2DHeader(const shmAxis& x, const shmAxis& y, const std::string& desc)
+	: _magic{magic()}, _x{x}, _y{y}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+
+	uint64_t _magic{0};
+	uint64_t _numSamples{0};
+	char _description[128] = {'\0'};
+	shmAxis _x;
+	shmAxis _y;
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmHist2DHeader& obj)
+{
+	stream << obj._description << " : _numSamples: " << obj._numSamples << std::endl
+		<< "\tx: " << obj._x << std::endl
+		<< "\ty: " << obj._y;
+	return stream;
+}
+
+struct histogram2d
+{
+	histogram2d(const shmAxis& x, const shmAxis& y, const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				shmHist2DHeader{x, y, desc},
+				x._numBuckets * y._numBuckets}
+	, _control{cnt._control}
+	{}
+
+	void sample(uint64_t x, uint64_t y)
+	{
+		if (!_control.enabled([](const controlEntry&){}))
+			return;
+
+		auto& header{_shmHist.header()};
+		const auto row{header._x.index(x)};
+		const auto column{header._y.index(y)};
+		if (row == header._x._numBuckets - 1)
+			++header._x._overfows;
+		if (column == header._y._numBuckets - 1)
+			++header._y._overfows;
+
+		++_shmHist.data()[row * header._y._numBuckets + column];
+		++header._numSamples;
+	}
+
+	// y is the nanos from begin(), x is known only at the end, e.g. the size of a reply
+	void begin()
+	{
+		_begin = std::chrono::steady_clock::now();
+	}
+	void end(uint64_t x)
+	{
+		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _begin).count()};
+		sample(x, static_cast<uint64_t>(diffNanos));
+	}
+
+	void resetSamples()
+	{
+		auto& header{_shmHist.header()};
+		header._numSamples = header._x._overfows = header._y._overfows = 0;
+		memset(_shmHist.dataAs<void*>(), 0, (_shmHist.endData() - _shmHist.data()) * sizeof(uint64_t));
+	}
+
+	uint64_t count(uint64_t row, uint64_t column) const
+	{
+		return _shmHist.data()[row * _shmHist.header()._y._numBuckets + column];
+	}
+
+	shmFile<shmHist2DHeader, uint64_t> _shmHist;
+	std::chrono::time_point<std::chrono::steady_clock> _begin;
+	controlled _control;
+};
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define HIST_PROFILER_HAS_TSC
+#endif
+
+namespace profiler
+{
+
+/*
+	ticks per nanosecond of the TSC, measured once per process against steady_clock, for 5 millis.
+	the metrics that consume stamps call instance() in their constructors, so the first sample doesn't wait for it.
+	invariant - the TSC runs at a constant rate and doesn't stop in deep C states,
+	without it stamps taken on different cores can't be compared and latencyToken uses CLOCK_MONOTONIC instead.
+*/
+struct tscCalibration
+{
+	static const tscCalibration& instance()
+	{
+		static const tscCalibration calibration;
+		return calibration;
+	}
+
+	// a cpuid, cheap enough for the first stamp of a producer
+	static bool invariantTsc()
+	{
+		static const bool invariant{[](){
+#if defined(HIST_PROFILER_HAS_TSC)
+			unsigned int eax{0}, ebx{0}, ecx{0}, edx{0};
+			return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)) != 0;
+#else
+			return false;
+#endif
+		}()};
+		return invariant;
+	}
+
+	double _nanosPerTick{1.0};
+	bool _invariant{false};
+
+private:
+	tscCalibration()
+	{
+#if defined(HIST_PROFILER_HAS_TSC)
+		_invariant = invariantTsc();
+
+		const auto beginTime{std::chrono::steady_clock::now()};
+		const auto beginTicks{__rdtsc()};
+		while (std::chrono::steady_clock::now() - beginTime < std::chrono::milliseconds{5})
+			;
+		const auto endTime{std::chrono::steady_clock::now()};
+		const auto endTicks{__rdtsc()};
+
+		const auto nanos{std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - beginTime).count()};
+		_nanosPerTick = static_cast<double>(nanos) / static_cast<double>(endTicks - beginTicks);
+#endif
+	}
+};
+
+/*
+	a compact timestamp taken by the producer of a message and consumed by the consumer
+	into a latency histogram, see timeHistogram::consume().
+	the top bit tells the source:
+		0 - TSC, cheapest, comparable between threads of the same process
+		1 - CLOCK_MONOTONIC nanos, comparable between processes of the same host,
+			for queues over shared memory
+	without an invariant TSC both sources are CLOCK_MONOTONIC
+*/
+struct latencyToken
+{
+	static constexpr uint64_t sharedBit() { return uint64_t{1} << 63; }
+
+	static uint64_t monotonicNanos()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+	}
+
+	static latencyToken now()
+	{
+#if defined(HIST_PROFILER_HAS_TSC)
+		if (tscCalibration::invariantTsc())
+			return latencyToken{__rdtsc() & ~sharedBit()};
+#endif
+		return shared();
+	}
+
+	static latencyToken shared()
+	{
+		return latencyToken{monotonicNanos() | sharedBit()};
+	}
+
+	bool isShared() const { return (_value & sharedBit()) != 0; }
+
+	// nanos from the stamp until now, negative when the clocks of the 2 sides are skewed
+	int64_t elapsedNanos() const
+	{
+		if (isShared())
+			return static_cast<int64_t>(monotonicNanos() - (_value & ~sharedBit()));
+
+#if defined(HIST_PROFILER_HAS_TSC)
+		const auto ticks{static_cast<int64_t>((__rdtsc() & ~sharedBit()) - _value)};
+		return static_cast<int64_t>(ticks * tscCalibration::instance()._nanosPerTick);
+#else
+		return 0;
+#endif
+	}
+
+	uint64_t _value{0};
+};
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace profiler
+{
+
+enum class clockSource : uint64_t
+{
+	systemClock,
+	steadyClock,
+	tsc,
+};
+
+inline const char* clockSourceName(clockSource source)
+{
+	switch (source)
+	{
+	case clockSource::systemClock: return "system_clock";
+	case clockSource::steadyClock: return "steady_clock";
+	case clockSource::tsc: return "tsc";
+	default: return "unknown";
+	}
+}
+
+/*
+	what an empty region measures, in nanos: the whole begin() and end() path of timeHistogram (regionOverhead).
+	every measured region includes it, readers can tell how much of a small region is the profiler.
+	_subtracted - the histogram subtracts _median from its samples before bucketing
+*/
+struct shmOverhead
+{
+	uint64_t _clockSource{0};
+	uint64_t _rounds{0};
+	uint64_t _min{0};
+	uint64_t _median{0};
+	uint64_t _p90{0};
+	uint64_t _p99{0};
+	uint64_t _max{0};
+	uint64_t _subtracted{0};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmOverhead& obj)
+{
+	stream << "overhead of " << clockSourceName(static_cast<clockSource>(obj._clockSource))
+		<< (obj._subtracted ? " (subtracted)" : "") << " : min: " << obj._min << ", median: " << obj._median
+		<< ", p90: " << obj._p90 << ", p99: " << obj._p99 << ", max: " << obj._max << ", rounds: " << obj._rounds;
+	return stream;
+}
+
+template <typename measure_t>
+shmOverhead calibrateOverhead(clockSource source, measure_t&& measureEmptyRegion)
+{
+	constexpr size_t rounds{10'000};
+	std::vector<uint64_t> samples(rounds);
+	// warm up the clock and the caches
+	for (size_t i = 0; i < rounds / 10; ++i)
+		measureEmptyRegion();
+	for (auto& sample : samples)
+		sample = measureEmptyRegion();
+	std::sort(samples.begin(), samples.end());
+
+	shmOverhead overhead;
+	overhead._clockSource = static_cast<uint64_t>(source);
+	overhead._rounds = rounds;
+	overhead._min = samples.front();
+	overhead._median = samples[rounds / 2];
+	overhead._p90 = samples[rounds * 90 / 100];
+	overhead._p99 = samples[rounds * 99 / 100];
+	overhead._max = samples.back();
+	return overhead;
+}
+
+template <typename clock_t>
+uint64_t emptyRegionNanos()
+{
+	const auto begin{clock_t::now()};
+	const auto end{clock_t::now()};
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+}
+
+// sample without the median overhead of its clock
+inline uint64_t withoutOverhead(uint64_t sample, const shmOverhead& overhead)
+{
+	return sample > overhead._median ? sample - overhead._median : 0;
+}
+
+}
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "shmFile.h"
+#include "registry.h"
+#include "latencyStamp.h"
+
+namespace profiler
+{
+
+/*
+	what a region costs besides time, counted by the kernel for the calling thread only.
+	hardware events fall back to taskClock when the PMU is not available, e.g. in VMs,
+	their histograms then have the nanos per bucket of the time histogram
+*/
+enum class perfEvent : uint64_t
+{
+	none,
+	cycles,
+	instructions,
+	cacheMisses,
+	branchMisses,
+	contextSwitches,
+	taskClock,
+};
+
+inline const char* perfEventName(perfEvent event)
+{
+	switch (event)
+	{
+	case perfEvent::cycles: return "cycles";
+	case perfEvent::instructions: return "instructions";
+	case perfEvent::cacheMisses: return "cacheMisses";
+	case perfEvent::branchMisses: return "branchMisses";
+	case perfEvent::contextSwitches: return "contextSwitches";
+	case perfEvent::taskClock: return "taskClock";
+	default: return "none";
+	}
+}
+
+constexpr size_t maxPerfEvents{4};
+
+// statistics of one counter, the same as the time histogram has
+struct shmPerfCounter
+{
+	void resetSamples()
+	{
+		_maxSample = _overfows = _sum = _numSamples = _multiplexed = 0;
+		_minSample = std::numeric_limits<uint64_t>::max();
+	}
+
+	uint64_t _requested{0}; // perfEvent
+	uint64_t _opened{0}; // perfEvent, none - not available, the counter histogram stays empty
+	uint64_t _rdpmc{0}; // read in user space, otherwise by read(2)
+	uint64_t _multiplexed{0}; // regions the counter shared the PMU with other events for, their counts are scaled estimates
+	uint64_t _unitsPerBucket{1};
+	uint64_t _maxSample{0};
+	uint64_t _minSample{std::numeric_limits<uint64_t>::max()};
+	uint64_t _overfows{0};
+	uint64_t _sum{0};
+	uint64_t _numSamples{0};
+};
+
+/*
+	data holds 1 + _numEvents arrays of _numBuckets:
+	[0, _numBuckets) - time in _samplesPerBucket nanos,
+	then one per counter in _counters[i]._unitsPerBucket events
+*/
+struct shmPerfHistHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE00000006; }
+public:
+	shmPerfHistHeader() = default;
+	shmPerfHistHeader(size_t samplesPerBucket, size_t numBuckets, size_t numEvents, const std::string& desc)
+	: _magic{magic()}, _samplesPerBucket{samplesPerBucket}, _numBuckets{numBuckets}, _numEvents{numEvents}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+	void resetSamples()
+	{
+		_maxSample = _overfows = _sum = _numSamples = 0;
+		_minSample = std::numeric_limits<uint64_t>::max();
+		for (auto& counter : _counters)
+			counter.resetSamples();
+	}
+
+	uint64_t _magic{0};
+	uint64_t _samplesPerBucket{1};
+	uint64_t _numBuckets{0};
+	uint64_t _maxSample{0};
+	uint64_t _minSample{std::numeric_limits<uint64_t>::max()};
+	uint64_t _overfows{0};
+	uint64_t _sum{0};
+	uint64_t _numSamples{0};
+	char _description[128] = {'\0'};
+	uint64_t _numEvents{0};
+	shmPerfCounter _counters[maxPerfEvents];
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmPerfHistHeader& obj)
+{
+	auto mean{obj._numSamples > 0 ? obj._sum / obj._numSamples : 0};
+	stream << obj._description
+		<< " : _numBuckets: " << obj._numBuckets << ", _samplesPerBucket: " << obj._samplesPerBucket
+		<< ", _maxSample: " << obj._maxSample << ", _minSample: " << obj._minSample
+		<< ", _overfows: " << obj._overfows << ", mean: " << mean << ", _numSamples: " << obj._numSamples;
+	for (size_t i = 0; i < obj._numEvents; ++i)
+	{
+		const auto& counter{obj._counters[i]};
+		const auto counterMean{counter._numSamples > 0 ? counter._sum / counter._numSamples : 0};
+		stream << std::endl << "\t" << perfEventName(static_cast<perfEvent>(counter._requested))
+			<< " -> " << perfEventName(static_cast<perfEvent>(counter._opened))
+			<< (counter._rdpmc ? " (rdpmc)" : "") << " : _unitsPerBucket: " << counter._unitsPerBucket
+			<< ", _maxSample: " << counter._maxSample << ", _overfows: " << counter._overfows
+			<< ", mean: " << counterMean << ", _numSamples: " << counter._numSamples << ", _multiplexed: " << counter._multiplexed;
+	}
+	return stream;
+}
+
+/*
+	a count with the times the event was enabled and running on the PMU, in nanos.
+	with more hardware events than counters the kernel multiplexes them, running < enabled
+*/
+struct perfReading
+{
+	uint64_t _count{0};
+	uint64_t _enabled{0};
+	uint64_t _running{0};
+};
+
+// events of a region, scaled up by enabled / running when the counter was multiplexed for part of it
+inline uint64_t regionCount(const perfReading& begin, const perfReading& end, bool& multiplexed)
+{
+	const auto count{end._count - begin._count};
+	const auto enabled{end._enabled - begin._enabled};
+	const auto running{end._running - begin._running};
+	multiplexed = running < enabled;
+	if (!multiplexed || running == 0)
+		return count;
+	return static_cast<uint64_t>(static_cast<double>(count) * static_cast<double>(enabled) / static_cast<double>(running));
+}
+
+/*
+	one perf event of the calling thread. hardware events are opened as a group, so all of them
+	are scheduled on the PMU together and count the same instructions,
+	software events are counted by the kernel and are opened on their own.
+	read with rdpmc from the mmapped page when the kernel allows it (perf_event_paranoid, cap_user_rdpmc)
+*/
+class perfCounter final
+{
+public:
+	perfCounter() = default;
+	perfCounter(const perfCounter&) = delete;
+	perfCounter& operator=(const perfCounter&) = delete;
+	~perfCounter()
+	{
+		if (_page != nullptr)
+			::munmap(_page, pageSize());
+		if (_fd >= 0)
+			::close(_fd);
+	}
+
+	/*
+		returns what was opened, none when neither the event nor its fallback is available.
+		a context switch is done by the kernel, it's counted there or not at all: perf_event_paranoid 1 or CAP_PERFMON
+	*/
+	perfEvent open(perfEvent event, int groupFd)
+	{
+		if (!hardware(event))
+			return tryOpen(event, -1) ? event : perfEvent::none;
+		if (tryOpen(event, groupFd))
+			return event;
+		if (tryOpen(perfEvent::taskClock, -1))
+			return perfEvent::taskClock;
+		return perfEvent::none;
+	}
+
+	static bool hardware(perfEvent event) { return event != perfEvent::contextSwitches && event != perfEvent::taskClock; }
+
+	int fd() const { return _fd; }
+	bool rdpmc() const { return _page != nullptr && _page->cap_user_rdpmc; }
+
+	// the times of the mmapped page are as of the last time the kernel scheduled the event in or out
+	perfReading read() const
+	{
+#if defined(HIST_PROFILER_HAS_TSC)
+		if (_page != nullptr)
+		{
+			uint32_t seq{0};
+			perfReading reading;
+			bool inUserSpace{false};
+			do
+			{
+				seq = _page->lock;
+				__atomic_signal_fence(__ATOMIC_SEQ_CST);
+				const auto index{_page->index};
+				reading._count = _page->offset;
+				reading._enabled = _page->time_enabled;
+				reading._running = _page->time_running;
+				inUserSpace = _page->cap_user_rdpmc && index != 0;
+				if (inUserSpace)
+				{
+					const auto width{_page->pmc_width};
+					auto pmc{static_cast<int64_t>(__rdpmc(index - 1))};
+					pmc <<= 64 - width;
+					pmc >>= 64 - width;
+					reading._count += pmc;
+				}
+				__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			} while (_page->lock != seq);
+
+			if (inUserSpace)
+				return reading;
+		}
+#endif
+		perfReading reading;
+		if (::read(_fd, &reading, sizeof(reading)) != sizeof(reading))
+			return {};
+		return reading;
+	}
+
+private:
+	static size_t pageSize() { return static_cast<size_t>(::sysconf(_SC_PAGESIZE)); }
+
+	bool tryOpen(perfEvent event, int groupFd)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.exclude_hv = 1;
+		// the layout of perfReading
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		switch (event)
+		{
+		case perfEvent::cycles: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+		case perfEvent::instructions: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+		case perfEvent::cacheMisses: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+		case perfEvent::branchMisses: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+		case perfEvent::contextSwitches: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES; break;
+		case perfEvent::taskClock: attr.type = PERF_TYPE_SOFTWARE; attr.config = PERF_COUNT_SW_TASK_CLOCK; break;
+		default: return false;
+		}
+		// user space only, allowed with perf_event_paranoid 2. a context switch is done by the kernel, so it's counted there
+		attr.exclude_kernel = event == perfEvent::contextSwitches ? 0 : 1;
+
+		// this thread on any cpu
+		_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+		if (_fd < 0)
+			return false;
+
+		auto* page{::mmap(nullptr, pageSize(), PROT_READ, MAP_SHARED, _fd, 0)};
+		if (page != MAP_FAILED)
+			_page = static_cast<perf_event_mmap_page*>(page);
+		return true;
+	}
+
+	int _fd{-1};
+	perf_event_mmap_page* _page{nullptr};
+};
+
+/*
+	timeHistogram of a region together with a histogram per perf event,
+	each region records its duration and how many events it took
+*/
+struct perfHistogram
+{
+	perfHistogram(uint64_t samplesPerBucket, uint64_t numBuckets, std::initializer_list<std::pair<perfEvent, uint64_t>> events,
+			const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				shmPerfHistHeader{samplesPerBucket, numBuckets, std::min(events.size(), maxPerfEvents), desc},
+				(1 + std::min(events.size(), maxPerfEvents)) * numBuckets}
+	, _control{cnt._control}
+	, _configuredSamplesPerBucket{samplesPerBucket}
+	{
+		auto& header{_shmHist.header()};
+		int groupFd{-1};
+		size_t i{0};
+		for (const auto& [event, unitsPerBucket] : events)
+		{
+			if (i == maxPerfEvents)
+				break;
+
+			auto& counter{header._counters[i]};
+			counter._requested = static_cast<uint64_t>(event);
+			counter._unitsPerBucket = std::max<uint64_t>(unitsPerBucket, 1);
+			counter._opened = static_cast<uint64_t>(_counters[i].open(event, groupFd));
+			counter._rdpmc = _counters[i].rdpmc();
+			// the caller's units were for the hardware event, the task clock counts nanos
+			if (fellBack(counter))
+				counter._unitsPerBucket = header._samplesPerBucket;
+			// the first hardware event opened leads the group
+			if (groupFd < 0 && _counters[i].fd() >= 0 && perfCounter::hardware(static_cast<perfEvent>(counter._opened)))
+				groupFd = _counters[i].fd();
+			++i;
+		}
+	}
+
+	void begin()
+	{
+		_sampled = _control.enabled([this](const controlEntry& entry){ applyControl(entry); });
+		if (!_sampled)
+			return;
+
+		const auto numEvents{_shmHist.header()._numEvents};
+		for (size_t i = 0; i < numEvents; ++i)
+			_beginCounts[i] = _counters[i].read();
+		_begin = std::chrono::steady_clock::now();
+	}
+
+	void end()
+	{
+		if (!_sampled)
+			return;
+
+		const auto end{std::chrono::steady_clock::now()};
+		uint64_t counts[maxPerfEvents];
+		auto& header{_shmHist.header()};
+		bool multiplexed[maxPerfEvents] = {};
+		for (size_t i = 0; i < header._numEvents; ++i)
+			counts[i] = regionCount(_beginCounts[i], _counters[i].read(), multiplexed[i]);
+
+		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(end - _begin).count()};
+		record(header._samplesPerBucket, header._numBuckets, static_cast<uint64_t>(diffNanos), _shmHist.data(),
+			   header._maxSample, header._minSample, header._overfows, header._sum, header._numSamples);
+
+		for (size_t i = 0; i < header._numEvents; ++i)
+		{
+			auto& counter{header._counters[i]};
+			if (counter._opened == static_cast<uint64_t>(perfEvent::none))
+				continue;
+			record(counter._unitsPerBucket, header._numBuckets, counts[i], _shmHist.data() + (i + 1) * header._numBuckets,
+				   counter._maxSample, counter._minSample, counter._overfows, counter._sum, counter._numSamples);
+			counter._multiplexed += multiplexed[i] ? 1 : 0;
+		}
+	}
+
+	static void record(uint64_t perBucket, uint64_t numBuckets, uint64_t sample, uint64_t* data,
+					   uint64_t& maxSample, uint64_t& minSample, uint64_t& overflows, uint64_t& sum, uint64_t& numSamples)
+	{
+		if (sample > maxSample)
+			maxSample = sample;
+		if (sample < minSample)
+			minSample = sample;
+
+		const auto bucket{perBucket > 1 ? sample / perBucket : sample};
+		if (bucket < numBuckets - 1)
+		{
+			++data[bucket];
+		}
+		else
+		{
+			++overflows;
+			++data[numBuckets - 1];
+		}
+
+		sum += bucket;
+		++numSamples;
+	}
+
+	// only the time resolution can be changed from the control page
+	void applyControl(const controlEntry& entry)
+	{
+		auto& header{_shmHist.header()};
+		const auto perBucket{entry._samplesPerBucket > 0 ? entry._samplesPerBucket : _configuredSamplesPerBucket};
+		if (perBucket != header._samplesPerBucket)
+		{
+			resetSamples();
+			header._samplesPerBucket = perBucket;
+			for (size_t i = 0; i < header._numEvents; ++i)
+			{
+				if (fellBack(header._counters[i]))
+					header._counters[i]._unitsPerBucket = perBucket;
+			}
+		}
+	}
+
+	// a hardware event that is counted by the task clock
+	static bool fellBack(const shmPerfCounter& counter)
+	{
+		return counter._requested != counter._opened && counter._opened == static_cast<uint64_t>(perfEvent::taskClock);
+	}
+
+	void resetSamples()
+	{
+		_shmHist.header().resetSamples();
+		memset(_shmHist.dataAs<void*>(), 0, (_shmHist.endData() - _shmHist.data()) * sizeof(uint64_t));
+	}
+
+	shmFile<shmPerfHistHeader, uint64_t> _shmHist;
+	perfCounter _counters[maxPerfEvents];
+	perfReading _beginCounts[maxPerfEvents] = {};
+	std::chrono::time_point<std::chrono::steady_clock> _begin;
+	bool _sampled{false};
+
+	controlled _control;
+	uint64_t _configuredSamplesPerBucket{1};
+};
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+
+#include "histogram.h"
+
+namespace profiler
+{
+
+/*
+	calls f(args...) between hist.begin() and hist.end().
+	arguments and the return value are perfectly forwarded, the result is returned
+	as is - void, references and move only types included.
+	end() runs from a destructor, so it also records when f throws
+*/
+template <typename func_t, typename ... args_t>
+decltype(auto) profiled(timeHistogram& hist, func_t&& f, args_t&& ... args)
+{
+	struct endGuard final
+	{
+		~endGuard() { _hist.end(); }
+		timeHistogram& _hist;
+	};
+
+	hist.begin();
+	endGuard guard{hist};
+	return std::invoke(std::forward<func_t>(f), std::forward<args_t>(args)...);
+}
+
+}
@@ -7,11 +7,31 @@
 
 #if defined (ENABLE_HIST_PROFILER)
 
+#include "registry.h"
 #include "histogram.h"
+#include "spanTree.h"
+#include "perfHistogram.h"
+#include "cpuTimeHistogram.h"
+#include "histogram2d.h"
+#include "valueHistogram.h"
+#include "ddSketch.h"
+#include "heatmap.h"
+#include "gauge.h"
+#include "aggregate.h"
+#include "coroSpan.h"
+#include "profiled.h"
 
 #define var(x) x##_cnt
+#define histConcatImpl(a, b) a##b
+#define histConcat(a, b) histConcatImpl(a, b)
 
 
+/*
+	every macro below registers its call site once in profiler::metricRegistry,
+	each thread gets its own instance - shmFile_<id>_<instance>.shm,
+	the instance number is unique per id across threads and call sites
+*/
+
 /*
 	simple histogram
 
@@ -23,11 +43,28 @@
 	SampleHist(histNum, std::round(dist(gen)));
 */
 #define ThreadLocalHist(id, num, XAxisDesc, description) \
-	static size_t var(id);	\
-	static thread_local profiler::histogram id{num, #id, ++var(id), XAxisDesc, description};
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::histogram};	\
+	static thread_local profiler::histogram id{num, #id, var(id).nextInstance(), XAxisDesc, description};
 
 #define SampleHist(id, num) do { id.sample(num); } while(false)
 
+/*
+	histogram that also keeps the worst samples with their context in its header
+
+	ThreadLocalHistExemplars(histNum, - shmFile_histNum.shm
+					100, - number of buckets
+					8, - number of worst samples to keep, up to profiler::maxExemplars
+					"$", - X axis description
+					"test hist with numbers");
+
+	SampleHistTagged(histNum, value, requestId);
+*/
+#define ThreadLocalHistExemplars(id, num, numExemplars, XAxisDesc, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::histogram};	\
+	static thread_local profiler::histogram id{num, #id, var(id).nextInstance(), XAxisDesc, description, numExemplars};
+
+#define SampleHistTagged(id, num, tag) do { id.sample(num, tag); } while(false)
+
 /*
 	used to measure code execution in specified time units,
 
@@ -41,13 +78,249 @@ TimeHistBegin(basic);
 TimeHistEnd(basic);
 */
 #define ThreadLocalTimeHist(id, perBucket, num, description) \
-	static size_t var(id);	\
-	static thread_local profiler::timeHistogram id{perBucket, num, #id, ++var(id), description};
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::timeHistogram id{perBucket, num, #id, var(id).nextInstance(), description};
 
 #define TimeHistBegin(id) do { id.begin(); } while(false)
 #define TimeHistEnd(id) do { id.end(); } while(false)
 #define TimeHistSample(id, beginTP, endTP) do { id.sample(beginTP, endTP); } while(false)
 
+/*
+	keeps the last regions of each thread in order, shmFile_events_<pid>_<tid>.shm, see profiler::eventRing.
+	set once per process before the histograms are created, histTrace turns the rings into a Chrome trace
+
+	EventRingConfigure(4096); - records per thread, 0 - off
+*/
+#define EventRingConfigure(numRecords) profiler::eventRing::configure(numRecords)
+
+/*
+	for thread pools that resize: when a thread exits its histogram is added to shmFile_<id>_0.shm,
+	the process total of the id, and its file is taken over by the next thread, see profiler::foldOnExit.
+	sampled with SampleHist, TimeHistBegin and TimeHistEnd like the others
+
+	ThreadLocalHistFolded(batchSizes, 100, "items", "batch sizes of the workers");
+	ThreadLocalTimeHistFolded(tasks, 1000, 500, "task latency of the workers");
+*/
+#define ThreadLocalHistFolded(id, num, XAxisDesc, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::histogram};	\
+	static thread_local profiler::foldOnExit<profiler::histogram> id{var(id), num, #id, profiler::pooled, XAxisDesc, description};
+
+#define ThreadLocalTimeHistFolded(id, perBucket, num, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::foldOnExit<profiler::timeHistogram> id{var(id), perBucket, num, #id, profiler::pooled, description};
+
+/*
+	profiles a call, each call site has its own histogram.
+	evaluates to whatever func returns, arguments are forwarded as is
+
+	auto ret{HistProfiled(getInt, - shmFile_getInt.shm
+					1000, - 1000 nanos per bucket - microseconds
+					500, - number of buckets
+					"getInt calls",
+					getInt, 1, 2)}; - func, args ...
+*/
+#define HistProfiled(id, perBucket, num, description, ...) \
+	[&]() -> decltype(auto) { \
+		ThreadLocalTimeHist(id, perBucket, num, description); \
+		return profiler::profiled(id, __VA_ARGS__); \
+	}()
+
+/*
+	same as ThreadLocalTimeHist, keeps the numExemplars slowest regions with their tags
+
+ThreadLocalTimeHistExemplars(basic, 1000, 500, 8, "basic test of macros");
+
+TimeHistBegin(basic);
+...
+TimeHistEndTagged(basic, requestId);
+*/
+#define ThreadLocalTimeHistExemplars(id, perBucket, num, numExemplars, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::timeHistogram id{perBucket, num, #id, var(id).nextInstance(), description, numExemplars};
+
+#define TimeHistEndTagged(id, tag) do { id.end(tag); } while(false)
+
+/*
+	for periodic work, corrects coordinated omission:
+	a region that took longer than the expected interval also records the samples
+	that should have been taken while it was running. 
+	raw and corrected distributions are kept side by side in the same file.
+
+ThreadLocalTimeHistCorrected(basic, 1000, 500, 
+					10'000'000, - a region is expected to start every 10 millis
+					"basic test of macros");
+*/
+#define ThreadLocalTimeHistCorrected(id, perBucket, num, expectedIntervalNanos, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::timeHistogram id{perBucket, num, #id, var(id).nextInstance(), description, 0, expectedIntervalNanos};
+
+/*
+	for very hot regions, only 1 in samplingRatio regions reads the clock and is recorded.
+	_numCalls in the header counts all of them, readers scale by _numCalls / _numSamples
+
+ThreadLocalTimeHistSampled(basic, 1000, 500, 
+					100, - measure 1 in 100
+					"basic test of macros");
+
+	or let the ratio follow the calls rate, so measuring costs at most the given budget
+
+ThreadLocalTimeHistAdaptive(basic, 1000, 500, 
+					1'000'000, - 1 milli of measuring per second
+					"basic test of macros");
+*/
+#define ThreadLocalTimeHistSampled(id, perBucket, num, samplingRatio, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::timeHistogram id{perBucket, num, #id, var(id).nextInstance(), description, 0, 0, samplingRatio};
+
+#define ThreadLocalTimeHistAdaptive(id, perBucket, num, budgetNanosPerSec, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::timeHistogram id{perBucket, num, #id, var(id).nextInstance(), description, 0, 0, 1, budgetNanosPerSec};
+
+/*
+	a time histogram keeps the cost of an empty begin() and end() in the header (_overhead).
+	for regions of tens of nanos, this one subtracts the median of it from every region measured by them,
+	samples of the caller's own measurements are recorded as they are
+
+ThreadLocalTimeHistOverheadFree(basic, 1, 500, "basic test of macros");
+*/
+#define ThreadLocalTimeHistOverheadFree(id, perBucket, num, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHistogram};	\
+	static thread_local profiler::timeHistogram id{perBucket, num, #id, var(id).nextInstance(), description, 0, 0, 1, 0, true};
+
+/*
+	the same regions as ThreadLocalTimeHist without choosing the range up front,
+	quantiles within the relative accuracy from nanos to hours, see profiler::timeSketch.
+	TimeHistBegin, TimeHistEnd and TimeHistSample work with both
+
+	ThreadLocalTimeSketch(requests,
+						  0.01, - quantiles within 1%
+						  2048, - max number of buckets, 16KB
+						  "request latency");
+*/
+#define ThreadLocalTimeSketch(id, relativeAccuracy, maxBuckets, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeSketch};	\
+	static thread_local profiler::timeSketch id{relativeAccuracy, maxBuckets, #id, var(id).nextInstance(), description};
+
+/*
+	region time together with perf event counts of the thread, a histogram for each.
+	hardware events fall back to taskClock when there is no PMU, see _counters[i]._opened in the header
+
+ThreadLocalPerfHist(basic, 1000, 500, "basic test of macros",
+					{profiler::perfEvent::cycles, 1000}, - 1000 cycles per bucket
+					{profiler::perfEvent::contextSwitches, 1}); - up to profiler::maxPerfEvents events
+
+PerfHistBegin(basic);
+...
+PerfHistEnd(basic);
+*/
+#define ThreadLocalPerfHist(id, perBucket, num, description, ...) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::perfHistogram};	\
+	static thread_local profiler::perfHistogram id{perBucket, num, {__VA_ARGS__}, #id, var(id).nextInstance(), description};
+
+#define PerfHistBegin(id) do { id.begin(); } while(false)
+#define PerfHistEnd(id) do { id.end(); } while(false)
+
+/*
+	wall time and cpu time of the thread in a region, and a third histogram of the time
+	it was not running - scheduling delay, blocking, sleeping. all in the same file
+
+ThreadLocalCpuTimeHist(basic, 1000, 500, "basic test of macros");
+
+CpuTimeHistBegin(basic);
+...
+CpuTimeHistEnd(basic);
+*/
+#define ThreadLocalCpuTimeHist(id, perBucket, num, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::cpuTimeHistogram};	\
+	static thread_local profiler::cpuTimeHistogram id{perBucket, num, #id, var(id).nextInstance(), description};
+
+#define CpuTimeHistBegin(id) do { id.begin(); } while(false)
+#define CpuTimeHistEnd(id) do { id.end(); } while(false)
+
+/*
+	2-D histogram, a row of y buckets per x bucket, e.g. latency by payload size.
+	each axis is profiler::linearAxis(unitsPerBucket, numBuckets, desc)
+	or profiler::logLinearAxis(unitsPerBucket, subBucketBits, numGroups, desc)
+
+	ThreadLocalHist2D(sizeLatency,
+					  profiler::logLinearAxis(1, 2, 20, "bytes"), - 4 buckets per power of 2 up to 8MB
+					  profiler::logLinearAxis(1000, 3, 20, "micros"),
+					  "reply latency by size");
+
+	SampleHist2D(sizeLatency, size, nanos);
+	or
+	Hist2DBegin(sizeLatency);
+	...
+	Hist2DEnd(sizeLatency, reply.size()); - y is the nanos since Hist2DBegin
+*/
+#define ThreadLocalHist2D(id, xAxis, yAxis, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::histogram2d};	\
+	static thread_local profiler::histogram2d id{xAxis, yAxis, #id, var(id).nextInstance(), description};
+
+#define SampleHist2D(id, x, y) do { id.sample(x, y); } while(false)
+#define Hist2DBegin(id) do { id.begin(); } while(false)
+#define Hist2DEnd(id, x) do { id.end(x); } while(false)
+
+/*
+	histogram of signed and fractional values, int64_t or double, see profiler::shmValueLayout.
+	the layout is profiler::linearValues(offset, bucketsPerUnit, numBuckets)
+	or profiler::symmetricLogLinearValues(resolution, subBucketBits, numGroups)
+
+	ThreadLocalValueHist(clockOffsets,
+						 profiler::symmetricLogLinearValues(1e-6, 3, 20), - from a micro to 8 seconds either way
+						 "seconds", "clock offset to the exchange");
+
+	SampleValueHist(clockOffsets, offset);
+	SampleValueHistBatch(clockOffsets, offsets.data(), offsets.size());
+*/
+#define ThreadLocalValueHist(id, layout, XAxisDesc, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::valueHistogram};	\
+	static thread_local profiler::valueHistogram id{layout, #id, var(id).nextInstance(), XAxisDesc, description};
+
+#define SampleValueHist(id, value) do { id.sample(value); } while(false)
+#define SampleValueHistBatch(id, values, num) do { id.sampleBatch(values, num); } while(false)
+
+/*
+	C++20, latency of a coroutine that may resume on other threads, see profiler::coroSpan.
+	recorded when the span goes out of scope, into the ThreadLocalCpuTimeHist of the thread it ends on.
+	the cpu time stops only in the awaits wrapped with CoroSpanAwait
+
+task handle(request req)
+{
+	CoroSpan(span, - the name of the span in the coroutine
+			 handleRequest, - shmFile_handleRequest.shm
+			 1000, 500, "request handling");
+	...
+	auto reply{co_await CoroSpanAwait(span, backend.call(req))};
+	...
+}
+*/
+#define CoroSpan(name, id, perBucket, num, description) \
+	profiler::coroSpan name{[]() -> profiler::cpuTimeHistogram& { \
+		ThreadLocalCpuTimeHist(id, perBucket, num, description) \
+		return id; \
+	}}
+
+#define CoroSpanAwait(name, awaitable) profiler::spanAwait(name, awaitable)
+
+/*
+	latency of messages between threads or processes.
+	the producer stamps a token into the message, the consumer records how long ago it was stamped.
+	LatencyStamp uses the TSC - threads of the same process, CLOCK_MONOTONIC when the TSC is not invariant,
+	LatencyStampShared uses CLOCK_MONOTONIC - queues over shared memory between processes.
+	tokens that look older than now on the consumer side are counted as _clockSkews
+
+	struct Node { int _id; profiler::latencyToken _sent; };
+	queue.push(Node{cnt++, LatencyStamp()});
+	...
+	ThreadLocalLatencyHist(threadComm, 1000, 300, "passing messages between threads");
+	LatencyHistConsume(threadComm, node._sent);
+*/
+#define LatencyStamp() profiler::latencyToken::now()
+#define LatencyStampShared() profiler::latencyToken::shared()
+#define ThreadLocalLatencyHist(id, perBucket, num, description) ThreadLocalTimeHist(id, perBucket, num, description)
+#define LatencyHistConsume(id, token) do { id.consume(token); } while(false)
+
 /*
 	used to measure rate per  specified time units - second or less than a second
 
@@ -59,24 +332,168 @@ TimeHistEnd(basic);
 	RateCntSample(rateEvents, 1);
 */
 #define ThreadLocalRateCnt(id, perBucket, num, description) \
-	static size_t var(id);	\
-	static thread_local profiler::rateCounter id{perBucket, num, #id, ++var(id), description};
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::rateCounter};	\
+	static thread_local profiler::rateCounter id{perBucket, num, #id, var(id).nextInstance(), description};
+
+/*
+	the same counts kept at coarser resolutions too, each a multiple of the first one
+
+	ThreadLocalRateCntResolutions(rateEvents,
+						1'000'000, 1000, - per milli, the last second
+						"events per milli, second and minute",
+						{1'000'000'000, 60}, - per second, the last minute
+						{60'000'000'000, 60}); - per minute, the last hour
+*/
+#define ThreadLocalRateCntResolutions(id, perBucket, num, description, ...) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::rateCounter};	\
+	static thread_local profiler::rateCounter id{perBucket, num, #id, var(id).nextInstance(), description, {__VA_ARGS__}};
 
 #define RateCntSample(id, num) do { id.sample(num); } while(false)
 
+/*
+	a value that goes up and down, kept as last, min, max and optionally the time weighted mean
+
+	ThreadLocalGauge(queueDepth, - shmFile_queueDepth_<n>.shm
+					 true, - time weighted mean
+					 "depth of the request queue");
+
+	GaugeSet(queueDepth, queue.size());
+	GaugeAdd(queueDepth, -1);
+
+	a file per thread, a value one thread adds to and another subtracts from belongs in a ProcessGauge
+*/
+#define ThreadLocalGauge(id, timeWeighted, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::gauge};	\
+	static thread_local profiler::gauge id{timeWeighted, #id, var(id).nextInstance(), description};
+
+/*
+	one gauge of the process updated by any thread under a lock, shmFile_<id>_1.shm.
+	the producer GaugeAdd(pending, 1), the consumers GaugeAdd(pending, -1)
+
+	ProcessGauge(pending, true, "messages produced and not consumed yet");
+*/
+#define ProcessGauge(id, timeWeighted, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::gauge};	\
+	static profiler::gauge id{timeWeighted, #id, var(id).nextInstance(), description, true};
+
+#define GaugeSet(id, value) do { id.set(value); } while(false)
+#define GaugeAdd(id, delta) do { id.add(delta); } while(false)
+
+/*
+	a monotonic count, a file per thread and process that readers sum, see profiler::counterTotal
+
+	ThreadLocalCounter(requests, "requests served");
+	CounterAdd(requests, 1);
+*/
+#define ThreadLocalCounter(id, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::counter};	\
+	static thread_local profiler::counter id{#id, var(id).nextInstance(), description};
+
+#define CounterAdd(id, num) do { id.add(num); } while(false)
+
+/*
+	latency distribution per interval, a ring of coarse histograms indexed like ThreadLocalRateCnt
+
+	ThreadLocalTimeHeatmap(requests,
+						   1'000'000'000, - a row per second
+						   300, - the last 5 minutes
+						   100'000, - 100 micros per latency bucket
+						   100, - latency buckets per row
+						   "request latency over time");
+
+	TimeHistBegin(requests);
+	...
+	TimeHistEnd(requests);
+*/
+#define ThreadLocalTimeHeatmap(id, nanosPerRow, numRows, perBucket, num, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::timeHeatmap};	\
+	static thread_local profiler::timeHeatmap id{nanosPerRow, numRows, perBucket, num, #id, var(id).nextInstance(), description};
+
+/*
+	call tree of nested regions per thread, each parent->child edge has its own histogram.
+	the tree is bounded by maxNodes, spans that don't fit are counted as dropped.
+
+	ThreadLocalSpanTree(spans, - shmFile_spans.shm
+						1000, - 1000 nanos per bucket - microseconds
+						100, - number of buckets per edge
+						64, - max number of edges
+						"request handling");
+
+	{
+		ScopedSpan(spans, "parse");
+		...
+	}
+*/
+#define ThreadLocalSpanTree(id, perBucket, num, maxNodes, description) \
+	static profiler::metricSite var(id){#id, description, profiler::metricKind::spanTree};	\
+	static thread_local profiler::spanTree id{perBucket, num, maxNodes, #id, var(id).nextInstance(), description};
+
+#define ScopedSpan(id, name) profiler::scopedSpan histConcat(span_, __LINE__){id, name}
+
 #pragma message "compiled with hist profiler enabled"
 
 #else
 
+#include <functional>
+#include "latencyStamp.h"
+
 #define ThreadLocalHist(id, num, description) do {;} while(false)
 #define SampleHist(id, num) do {;} while(false)
+#define ThreadLocalHistExemplars(id, num, numExemplars, XAxisDesc, description) do {;} while(false)
+#define SampleHistTagged(id, num, tag) do {;} while(false)
 
 #define ThreadLocalTimeHist(id, perBucket, num, description) do{;}while(false)
+#define ThreadLocalTimeSketch(id, relativeAccuracy, maxBuckets, description) do{;}while(false)
+#define ThreadLocalHistFolded(id, num, XAxisDesc, description) do{;}while(false)
+#define ThreadLocalTimeHistFolded(id, perBucket, num, description) do{;}while(false)
 #define TimeHistBegin(id) do{;}while(false)
 #define TimeHistEnd(id) do{;}while(false)
 #define TimeHistSample(beginTP, endTP) do{;}while(false)
+#define EventRingConfigure(numRecords) do{;}while(false)
+#define HistProfiled(id, perBucket, num, description, ...) std::invoke(__VA_ARGS__)
+#define ThreadLocalTimeHistExemplars(id, perBucket, num, numExemplars, description) do{;}while(false)
+#define TimeHistEndTagged(id, tag) do{;}while(false)
+#define ThreadLocalTimeHistCorrected(id, perBucket, num, expectedIntervalNanos, description) do{;}while(false)
+#define ThreadLocalTimeHistSampled(id, perBucket, num, samplingRatio, description) do{;}while(false)
+#define ThreadLocalTimeHistAdaptive(id, perBucket, num, budgetNanosPerSec, description) do{;}while(false)
+#define ThreadLocalTimeHistOverheadFree(id, perBucket, num, description) do{;}while(false)
+
+#define ThreadLocalPerfHist(id, perBucket, num, description, ...) do{;}while(false)
+#define PerfHistBegin(id) do{;}while(false)
+#define PerfHistEnd(id) do{;}while(false)
+
+#define ThreadLocalCpuTimeHist(id, perBucket, num, description) do{;}while(false)
+#define CpuTimeHistBegin(id) do{;}while(false)
+#define CpuTimeHistEnd(id) do{;}while(false)
+
+#define ThreadLocalHist2D(id, xAxis, yAxis, description) do{;}while(false)
+#define SampleHist2D(id, x, y) do{;}while(false)
+#define Hist2DBegin(id) do{;}while(false)
+#define Hist2DEnd(id, x) do{;}while(false)
+#define ThreadLocalValueHist(id, layout, XAxisDesc, description) do{;}while(false)
+#define SampleValueHist(id, value) do{;}while(false)
+#define SampleValueHistBatch(id, values, num) do{;}while(false)
+
+#define CoroSpan(name, id, perBucket, num, description) do{;}while(false)
+#define CoroSpanAwait(name, awaitable) (awaitable)
+
+#define LatencyStamp() profiler::latencyToken{}
+#define LatencyStampShared() profiler::latencyToken{}
+#define ThreadLocalLatencyHist(id, perBucket, num, description) do{;}while(false)
+#define LatencyHistConsume(id, token) do{;}while(false)
 
 #define ThreadLocalRateCnt(id, perBucket, num, description) do{;}while(false)
+#define ThreadLocalRateCntResolutions(id, perBucket, num, description, ...) do{;}while(false)
 #define RateCntSample(id, num) do {;} while(false)
+#define ThreadLocalGauge(id, timeWeighted, description) do{;}while(false)
+#define ProcessGauge(id, timeWeighted, description) do{;}while(false)
+#define GaugeSet(id, value) do{;}while(false)
+#define GaugeAdd(id, delta) do{;}while(false)
+#define ThreadLocalCounter(id, description) do{;}while(false)
+#define CounterAdd(id, num) do{;}while(false)
+#define ThreadLocalTimeHeatmap(id, nanosPerRow, numRows, perBucket, num, description) do{;}while(false)
+
+#define ThreadLocalSpanTree(id, perBucket, num, maxNodes, description) do{;}while(false)
+#define ScopedSpan(id, name) do{;}while(false)
 
 #endif
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <stdexcept>
+#include <string.h>
+
+#include "utils.h"
+#include "control.h"
+
+namespace profiler
+{
+
+enum class metricKind : uint64_t
+{
+	histogram,
+	timeHistogram,
+	rateCounter,
+	spanTree,
+	perfHistogram,
+	cpuTimeHistogram,
+	histogram2d,
+	timeSketch,
+	timeHeatmap,
+	gauge,
+	counter,
+	valueHistogram,
+};
+
+constexpr size_t maxMetricSites{1024};
+
+struct metricSite;
+
+/*
+	what a metric gets from its call site: the number in its file name and its control entry.
+	a plain number converts to an instance which is always enabled
+*/
+struct metricInstance
+{
+	metricInstance(size_t number)
+	: _number{number}
+	{}
+	metricInstance(size_t number, const controlEntry& control)
+	: _number{number}, _control{&control}
+	{}
+
+	size_t _number;
+	const controlEntry* _control{&controlPage::alwaysOn()};
+};
+
+/*
+	process wide list of the metric call sites.
+	a site registers once, when its function local static is initialized,
+	threads only ask it for an instance number, the hot path never gets here.
+*/
+class metricRegistry final
+{
+public:
+	static metricRegistry& instance()
+	{
+		static metricRegistry registry;
+		return registry;
+	}
+
+	// returns the slot of the site
+	size_t add(metricSite& site);
+
+	size_t size() const { return std::min(_numSites.load(std::memory_order_acquire), maxMetricSites); }
+	const metricSite* site(size_t slot) const { return _sites[slot].load(std::memory_order_acquire); }
+
+private:
+	metricRegistry() = default;
+
+	std::mutex _mtx; // registration only
+	std::atomic<size_t> _numSites{0};
+	std::atomic<metricSite*> _sites[maxMetricSites] = {};
+};
+
+/*
+	metadata of a call site, the id is the compile time string of the macro.
+	call sites with the same id share the instance counter, so every thread
+	of every such call site gets a unique shmFile_<id>_<instance>.shm
+*/
+struct metricSite final
+{
+	metricSite(const char* id, const char* description, metricKind kind)
+	: _id{id}, _description{description}, _kind{kind}
+	{
+		_slot = metricRegistry::instance().add(*this);
+	}
+	metricSite(const metricSite&) = delete;
+	metricSite& operator=(const metricSite&) = delete;
+
+	// unique per id, starts from 1
+	metricInstance nextInstance() { return {_sharedInstances->fetch_add(1, std::memory_order_relaxed) + 1, *_control}; }
+
+	const char* _id;
+	const char* _description;
+	metricKind _kind;
+	size_t _slot{0};
+	std::atomic<size_t> _instances{0};
+	std::atomic<size_t>* _sharedInstances{&_instances};
+	const controlEntry* _control{&controlPage::alwaysOn()};
+};
+
+inline size_t metricRegistry::add(metricSite& site)
+{
+	std::lock_guard<std::mutex> l{_mtx};
+
+	const auto slot{_numSites.load(std::memory_order_relaxed)};
+	if (slot >= maxMetricSites)
+	{
+		Throw(std::runtime_error) << "too many metric call sites, max: " << maxMetricSites
+								  << ", registering: " << site._id << End;
+	}
+
+	for (size_t i = 0; i < slot; ++i)
+	{
+		auto* other{_sites[i].load(std::memory_order_relaxed)};
+		if (strcmp(other->_id, site._id) == 0)
+		{
+			site._sharedInstances = other->_sharedInstances;
+			break;
+		}
+	}
+
+	site._control = &controlPage::instance(maxMetricSites).add(slot, site._id, static_cast<uint64_t>(site._kind));
+
+	_sites[slot].store(&site, std::memory_order_release);
+	_numSites.store(slot + 1, std::memory_order_release);
+	return slot;
+}
+
+}
@@ -27,6 +27,7 @@ class shmFile final
 public:
 	shmFile() = default;
 	shmFile(std::filesystem::path filename, HeaderType&& header, size_t dataSize);
+	explicit shmFile(std::filesystem::path filename); // maps an existing file, for readers and tools
 	shmFile(shmFile&&) = default;
 	shmFile& operator=(shmFile&&) = default;
 	shmFile(shmFile&) = delete;
@@ -112,6 +113,49 @@ shmFile<HeaderType, DataType>::shmFile(std::filesystem::path filename, HeaderTyp
     std::cout << "Success to create shmFile: " << *this << std::endl;
 }
 
+template <typename HeaderType, typename DataType>
+shmFile<HeaderType, DataType>::shmFile(std::filesystem::path filename)
+    :_filename{std::move(filename)}
+{
+	struct RAII final
+	{
+		int _fd{ -1 };
+		~RAII() { if (_fd != -1) { close(_fd); } }
+	};
+	RAII raii;
+    raii._fd = ::open(_filename.c_str(), O_RDWR);
+	if (-1 == raii._fd)
+	{
+		const auto err{ errno };
+		Throw(std::runtime_error) << " FAILED to open " << _filename 
+								  << ", errno: " << err << End;
+	}
+
+    constexpr size_t pageSize{4096};
+    constexpr auto headerSizeBytes{pageSize * ((sizeof(HeaderType) / pageSize) + 1)};
+
+	struct stat st;
+	if (-1 == ::fstat(raii._fd, &st) || static_cast<size_t>(st.st_size) < headerSizeBytes)
+	{
+		const auto err{ errno };
+		Throw(std::runtime_error) << " FAILED to stat " << _filename 
+								  << " or it is too small, errno: " << err << End;
+	}
+    const auto totalSize{static_cast<size_t>(st.st_size)};
+
+	auto* beginAddr{mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, raii._fd, 0)};
+	if (beginAddr == reinterpret_cast<void*>(-1))
+	{
+		const auto err{ errno };
+		Throw(std::runtime_error) << " FAILED to mmap " << _filename
+								  << ", size: " << totalSize << ", errno: " << err << End;
+	}
+
+    _headerAddr = reinterpret_cast<uint8_t*>(beginAddr);
+    _dataAddr = _headerAddr + headerSizeBytes;
+    _endDataAddr = _headerAddr + totalSize;
+}
+
 template <typename HeaderType, typename DataType>
 shmFile<HeaderType, DataType>::~shmFile()
 {
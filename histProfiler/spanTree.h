@@ -0,0 +1,245 @@
+#pragma once
+
+#include <chrono>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include "shmFile.h"
+#include "registry.h"
+
+namespace profiler
+{
+
+/*
+	per thread call tree of nested regions.
+	each node is a parent->child edge and keeps the latency histogram of the child
+	when it runs under that parent, so a parent's tail can be traced to its children.
+	node 0 is the thread itself, the root of every tree.
+*/
+struct shmSpanTreeHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE00000004; }
+public:
+	shmSpanTreeHeader() = default;
+	shmSpanTreeHeader(size_t samplesPerBucket, size_t numBuckets, size_t maxNodes, const std::string& desc)
+	: _magic{magic()}, _samplesPerBucket{samplesPerBucket}, _numBuckets{numBuckets}, _maxNodes{maxNodes}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+	}
+
+	uint64_t _magic{0};
+	uint64_t _samplesPerBucket{1};
+	uint64_t _numBuckets{0};
+	uint64_t _maxNodes{0};
+	uint64_t _numNodes{0};
+	uint64_t _droppedSpans{0}; // no room in the tree or the stack is too deep
+	char _description[128] = {'\0'};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmSpanTreeHeader& obj)
+{
+	stream << obj._description
+		<< " : _numBuckets: " << obj._numBuckets << ", _samplesPerBucket: " << obj._samplesPerBucket
+		<< ", _maxNodes: " << obj._maxNodes << ", _numNodes: " << obj._numNodes << ", _droppedSpans: " << obj._droppedSpans;
+	return stream;
+}
+
+/*
+	data is an array of _maxNodes records:
+	+-------------+------------------------+
+	| shmSpanNode | uint64_t [_numBuckets] |
+	+-------------+------------------------+
+	children are linked by index, 0 - no node, the root is never a child
+*/
+struct shmSpanNode
+{
+	uint64_t _parent{0};
+	uint64_t _firstChild{0};
+	uint64_t _nextSibling{0};
+	uint64_t _maxSample{0};
+	uint64_t _minSample{std::numeric_limits<uint64_t>::max()};
+	uint64_t _overfows{0};
+	uint64_t _sum{0};
+	uint64_t _numSamples{0};
+	char _name[64] = {'\0'};
+};
+
+constexpr size_t maxSpanDepth{64};
+
+struct spanTree
+{
+	spanTree(uint64_t samplesPerBucket, uint64_t numBuckets, uint64_t maxNodes,
+			 const std::string& id, metricInstance cnt, const std::string& desc)
+	: _shmTree{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				shmSpanTreeHeader{samplesPerBucket, numBuckets, maxNodes, desc},
+				maxNodes * (nodeWords() + numBuckets)}
+	, _stride{nodeWords() + numBuckets}
+	, _siteKeys(maxNodes, nullptr)
+	, _control{cnt._control}
+	{
+		auto& header{_shmTree.header()};
+		auto& root{node(0)};
+		root = shmSpanNode{};
+		strncpy(root._name, id.c_str(), sizeof(root._name) - 1);
+		header._numNodes = 1;
+	}
+
+	static constexpr size_t nodeWords() { return sizeof(shmSpanNode) / sizeof(uint64_t); }
+
+	shmSpanNode& node(uint64_t index) { return *reinterpret_cast<shmSpanNode*>(_shmTree.data() + index * _stride); }
+	const shmSpanNode& node(uint64_t index) const { return *reinterpret_cast<const shmSpanNode*>(_shmTree.data() + index * _stride); }
+	uint64_t* buckets(uint64_t index) { return _shmTree.data() + index * _stride + nodeWords(); }
+
+	/*
+		the node of the edge parent -> site, created on first use.
+		site is the identity of the call site, compared by address
+	*/
+	uint64_t child(uint64_t parent, const char* site)
+	{
+		for (auto index = node(parent)._firstChild; index != 0; index = node(index)._nextSibling)
+		{
+			if (_siteKeys[index] == site)
+				return index;
+		}
+
+		auto& header{_shmTree.header()};
+		if (header._numNodes >= header._maxNodes)
+			return noNode();
+
+		const auto index{header._numNodes};
+		auto& newNode{node(index)};
+		newNode = shmSpanNode{};
+		newNode._parent = parent;
+		newNode._nextSibling = node(parent)._firstChild;
+		strncpy(newNode._name, site, sizeof(newNode._name) - 1);
+		_siteKeys[index] = site;
+
+		// publish after the node is complete
+		node(parent)._firstChild = index;
+		header._numNodes = index + 1;
+
+		return index;
+	}
+
+	/*
+		disabled from the control page when the outermost span begins, its whole subtree is skipped.
+		a span is recorded by pop() when it was sampled by push(), so a toggle never leaves a span half measured
+	*/
+	void push(const char* site)
+	{
+		if (_depth < maxSpanDepth)
+		{
+			auto& top{_stack[_depth]};
+			top._sampled = (_depth == 0 || _stack[_depth - 1]._sampled) && _control.enabled([](const controlEntry&){});
+			if (top._sampled)
+			{
+				const auto parent{_depth > 0 ? _stack[_depth - 1]._node : 0};
+				top._node = parent == noNode() ? noNode() : child(parent, site);
+				top._begin = std::chrono::steady_clock::now();
+			}
+		}
+		++_depth;
+	}
+
+	void pop()
+	{
+		--_depth;
+		if (_depth < maxSpanDepth && !_stack[_depth]._sampled)
+			return;
+		if (_depth >= maxSpanDepth || _stack[_depth]._node == noNode())
+		{
+			++_shmTree.header()._droppedSpans;
+			return;
+		}
+
+		const auto end{std::chrono::steady_clock::now()};
+		const auto diffNanos{std::chrono::duration_cast<std::chrono::nanoseconds>(end - _stack[_depth]._begin).count()};
+		sample(_stack[_depth]._node, static_cast<uint64_t>(diffNanos));
+	}
+
+	void sample(uint64_t index, uint64_t sample)
+	{
+		const auto& header{_shmTree.header()};
+		auto& edge{node(index)};
+		auto* data{buckets(index)};
+
+		if (sample > edge._maxSample)
+			edge._maxSample = sample;
+		if (sample < edge._minSample)
+			edge._minSample = sample;
+
+		const auto bucket{header._samplesPerBucket > 1 ? sample / header._samplesPerBucket : sample};
+		if (bucket < header._numBuckets - 1)
+		{
+			++data[bucket];
+		}
+		else
+		{
+			++edge._overfows;
+			++data[header._numBuckets - 1];
+		}
+
+		edge._sum += bucket;
+		++edge._numSamples;
+	}
+
+	static constexpr uint64_t noNode() { return std::numeric_limits<uint64_t>::max(); }
+
+	struct frame
+	{
+		uint64_t _node{0};
+		std::chrono::time_point<std::chrono::steady_clock> _begin;
+		bool _sampled{false};
+	};
+
+	shmFile<shmSpanTreeHeader, uint64_t> _shmTree;
+	uint64_t _stride{0};
+	std::vector<const char*> _siteKeys; // sized once, never grows
+	size_t _depth{0};
+	frame _stack[maxSpanDepth];
+	controlled _control;
+};
+
+inline void printSpanNode(std::ostream& stream, const spanTree& tree, uint64_t index, size_t depth)
+{
+	const auto& n{tree.node(index)};
+	const auto mean{n._numSamples > 0 ? n._sum / n._numSamples : 0};
+	stream << std::string(depth * 2, ' ') << n._name
+		<< " : _numSamples: " << n._numSamples << ", mean: " << mean
+		<< ", _maxSample: " << n._maxSample << ", _overfows: " << n._overfows << std::endl;
+
+	for (auto child = n._firstChild; child != 0; child = tree.node(child)._nextSibling)
+		printSpanNode(stream, tree, child, depth + 1);
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const spanTree& obj)
+{
+	stream << obj._shmTree.header() << std::endl;
+	printSpanNode(stream, obj, 0, 0);
+	return stream;
+}
+
+/*
+	RAII span, the duration is recorded on the edge from the enclosing span
+*/
+struct scopedSpan
+{
+	scopedSpan(spanTree& tree, const char* site)
+	: _tree{tree}
+	{
+		_tree.push(site);
+	}
+	~scopedSpan()
+	{
+		_tree.pop();
+	}
+	scopedSpan(const scopedSpan&) = delete;
+	scopedSpan& operator=(const scopedSpan&) = delete;
+
+	spanTree& _tree;
+};
+
+}
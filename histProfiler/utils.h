@@ -2,6 +2,9 @@
 
 #include <exception>
 #include <sstream>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 namespace profiler {
 
@@ -34,4 +37,10 @@ struct throwExceptionImpl final
 #define Throw(type) throwExceptionImpl<type>{__FILE__, __LINE__}
 #define End throwParam{}
 
+// kernel thread id, matches what top/perf show
+inline uint64_t threadId()
+{
+	return static_cast<uint64_t>(::syscall(SYS_gettid));
+}
+
 }
\ No newline at end of file
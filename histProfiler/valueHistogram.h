@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <string.h>
+
+#include "shmFile.h"
+#include "registry.h"
+#include "histogram2d.h"
+
+namespace profiler
+{
+
+enum class valueScale : uint64_t
+{
+	linear,
+	symmetricLogLinear,
+};
+
+/*
+	buckets of signed and fractional values, clock offsets, P&L deltas.
+	linear - bucket 0 is below _offset, then a bucket per 1 / _perUnit from _offset, the last one at and above the range.
+	symmetricLogLinear - logLinearBucket of |value| * _perUnit on both sides of _zeroBucket,
+		which has the values with |value| < 1 / _perUnit, negative values below it, positive above.
+		buckets 0 and _numBuckets - 1 are below and above the range.
+	the index is arithmetic with min, max and a sign select, no branches on the value. NaN counts as above the range
+*/
+struct shmValueLayout
+{
+	uint64_t index(double value) const
+	{
+		if (static_cast<valueScale>(_scale) == valueScale::linear)
+		{
+			const auto top{static_cast<double>(_numBuckets - 1)};
+			return static_cast<uint64_t>(std::min(top, std::max((value - _offset) * _perUnit + 1.0, 0.0)));
+		}
+		// below 2^62 units, the conversion to integer is defined
+		const auto units{static_cast<uint64_t>(std::min(0x1p62, std::fabs(value) * _perUnit))};
+		const auto bucket{std::min(logLinearBucket(units, _subBucketBits), _zeroBucket)};
+		return value < 0 ? _zeroBucket - bucket : _zeroBucket + bucket;
+	}
+
+	// the smallest value of a bucket, for readers
+	double lowerBound(uint64_t bucket) const
+	{
+		if (static_cast<valueScale>(_scale) == valueScale::linear)
+		{
+			return bucket == 0 ? -std::numeric_limits<double>::infinity()
+							   : _offset + static_cast<double>(bucket - 1) / _perUnit;
+		}
+		if (bucket == 0)
+			return -std::numeric_limits<double>::infinity();
+		if (bucket > _zeroBucket)
+			return static_cast<double>(logLinearLowerBound(bucket - _zeroBucket, _subBucketBits)) / _perUnit;
+		// the magnitudes of a negative bucket (and of the zero bucket) end where the next bucket away from zero starts
+		return -static_cast<double>(logLinearLowerBound(_zeroBucket - bucket + 1, _subBucketBits)) / _perUnit;
+	}
+
+	uint64_t _scale{0};
+	double _offset{0};
+	double _perUnit{1};
+	uint64_t _subBucketBits{0};
+	uint64_t _numBuckets{3};
+	uint64_t _zeroBucket{0}; // of symmetricLogLinear
+};
+
+// numBuckets of 1 / bucketsPerUnit from offset, plus a bucket below and one above
+inline shmValueLayout linearValues(double offset, double bucketsPerUnit, uint64_t numBuckets)
+{
+	shmValueLayout layout;
+	layout._scale = static_cast<uint64_t>(valueScale::linear);
+	layout._offset = offset;
+	layout._perUnit = bucketsPerUnit > 0 ? bucketsPerUnit : 1;
+	layout._numBuckets = std::max<uint64_t>(numBuckets, 1) + 2;
+	return layout;
+}
+
+// magnitudes from resolution up to resolution * 2^(subBucketBits + numGroups) on each side of zero
+inline shmValueLayout symmetricLogLinearValues(double resolution, uint64_t subBucketBits, uint64_t numGroups)
+{
+	shmValueLayout layout;
+	layout._scale = static_cast<uint64_t>(valueScale::symmetricLogLinear);
+	layout._perUnit = resolution > 0 ? 1 / resolution : 1;
+	layout._subBucketBits = subBucketBits;
+	layout._zeroBucket = (numGroups + 1) << subBucketBits;
+	layout._numBuckets = 2 * layout._zeroBucket + 1;
+	return layout;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const shmValueLayout& obj)
+{
+	stream << (static_cast<valueScale>(obj._scale) == valueScale::linear ? "linear" : "symmetric log linear")
+		<< ", _offset: " << obj._offset << ", _perUnit: " << obj._perUnit << ", _subBucketBits: " << obj._subBucketBits
+		<< ", _numBuckets: " << obj._numBuckets << ", _zeroBucket: " << obj._zeroBucket;
+	return stream;
+}
+
+struct shmValueHistHeader
+{
+	static constexpr uint64_t magic() { return 0x0BADBABE0000000E; }
+public:
+	shmValueHistHeader() = default;
+	shmValueHistHeader(const shmValueLayout& layout, const std::string& xAxisDesc, const std::string& desc)
+	: _magic{magic()}, _layout{layout}
+	{
+		strncpy(_description, desc.c_str(), sizeof(_description) - 1);
+		strncpy(_XAxisDescription, xAxisDesc.c_str(), sizeof(_XAxisDescription) - 1);
+	}
+
+	uint64_t _magic{0};
+	shmValueLayout _layout;
+	double _maxSample{std::numeric_limits<double>::lowest()};
+	double _minSample{std::numeric_limits<double>::max()};
+	double _sum{0};
+	uint64_t _underflows{0};
+	uint64_t _overfows{0};
+	uint64_t _numSamples{0};
+	char _description[128] = {'\0'};
+	char _XAxisDescription[128] = {'\0'};
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const shmValueHistHeader& obj)
+{
+	const auto mean{obj._numSamples > 0 ? obj._sum / static_cast<double>(obj._numSamples) : 0};
+	stream << obj._description << " : " << obj._layout
+		<< ", _maxSample: " << obj._maxSample << ", _minSample: " << obj._minSample
+		<< ", _underflows: " << obj._underflows << ", _overfows: " << obj._overfows
+		<< ", mean: " << mean << ", _numSamples: " << obj._numSamples;
+	return stream;
+}
+
+/*
+	a histogram of int64_t and double values, see shmValueLayout.
+	sampleBatch takes an array: one control check, the stats are kept in registers and stored once
+*/
+struct valueHistogram
+{
+	valueHistogram(const shmValueLayout& layout, const std::string& id, metricInstance cnt,
+				   const std::string& xAxisDesc, const std::string& desc)
+	: _shmHist{"shmFile_" + id + "_" + std::to_string(cnt._number) + ".shm",
+				shmValueHistHeader{layout, xAxisDesc, desc}, layout._numBuckets}
+	, _control{cnt._control}
+	{}
+
+	void sample(double value)
+	{
+		sampleBatch(&value, 1);
+	}
+
+	template <typename int_t, std::enable_if_t<std::is_integral_v<int_t>, int> = 0>
+	void sample(int_t value)
+	{
+		sample(static_cast<double>(value));
+	}
+
+	template <typename value_t>
+	void sampleBatch(const value_t* values, size_t num)
+	{
+		static_assert(std::is_arithmetic_v<value_t>, "int64_t, double and the like");
+		if (num == 0 || !_control.enabled([](const controlEntry&){}))
+			return;
+
+		auto& header{_shmHist.header()};
+		const auto layout{header._layout};
+		const auto top{layout._numBuckets - 1};
+		auto* data{_shmHist.data()};
+
+		auto maxSample{header._maxSample};
+		auto minSample{header._minSample};
+		auto sum{header._sum};
+		uint64_t underflows{0};
+		uint64_t overflows{0};
+		for (size_t i = 0; i < num; ++i)
+		{
+			const auto value{static_cast<double>(values[i])};
+			const auto bucket{layout.index(value)};
+			++data[bucket];
+			underflows += bucket == 0;
+			overflows += bucket == top;
+			// NaN is counted in the top bucket and left out of the stats: the comparisons with it are false,
+			// std::max and std::min keep the first argument and the sum adds 0
+			maxSample = std::max(maxSample, value);
+			minSample = std::min(minSample, value);
+			sum += value == value ? value : 0;
+		}
+		header._maxSample = maxSample;
+		header._minSample = minSample;
+		header._sum = sum;
+		header._underflows += underflows;
+		header._overfows += overflows;
+		header._numSamples += num;
+	}
+
+	void resetSamples()
+	{
+		auto& header{_shmHist.header()};
+		header._maxSample = std::numeric_limits<double>::lowest();
+		header._minSample = std::numeric_limits<double>::max();
+		header._sum = 0;
+		header._underflows = header._overfows = header._numSamples = 0;
+		memset(_shmHist.dataAs<void*>(), 0, (_shmHist.endData() - _shmHist.data()) * sizeof(uint64_t));
+	}
+
+	shmFile<shmValueHistHeader, uint64_t> _shmHist;
+	controlled _control;
+};
+
+}
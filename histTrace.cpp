@@ -0,0 +1,39 @@
+#include "histProfiler/eventRing.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/*
+	converts the event rings of threads into a Chrome trace, for chrome://tracing or ui.perfetto.dev
+
+	histTrace <trace.json> shmFile_events_<pid>_<tid>.shm ...
+
+	the names of the regions come from shmFile_control_<pid>.shm next to the rings
+*/
+
+int usage(const std::string& desc)
+{
+	std::cout << desc << std::endl
+		<< "histTrace <trace.json> <event ring file> ..." << std::endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+		return usage("Usage");
+
+	std::ofstream out{argv[1]};
+	if (!out)
+		return usage(std::string{"FAILED to open "} + argv[1]);
+
+	size_t numEvents{0};
+	{
+		profiler::chromeTrace trace{out};
+		for (int i = 2; i < argc; ++i)
+			numEvents += trace.add(argv[i]);
+	}
+	std::cout << numEvents << " events written to " << argv[1] << std::endl;
+	return 0;
+}
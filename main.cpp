@@ -221,12 +221,6 @@ void pinCpu()
 #endif
 }
 
-template <typename func, typename ... args_t>
-auto profiled(func f, args_t ... args)
-{
-	return f(args...);
-}
-
 void printInt(int p1, int p2)
 {
 	if (p1 == p2)
@@ -243,8 +237,8 @@ int getInt(int p1, int p2)
 
 int main(int argc, char* argv[])
 {
-	profiled(printInt, 1, 2);
-	int ret = profiled(getInt, 1, 2);
+	HistProfiled(profiledPrintInt, 1000, 100, "printInt calls", printInt, 1, 2);
+	int ret = HistProfiled(profiledGetInt, 1000, 100, "getInt calls", getInt, 1, 2);
 	std::cout << "ret: " << ret << std::endl;
 
 	parseArgv(argc, argv);
@@ -3,9 +3,10 @@ from matplotlib import pyplot as plt
 import numpy as np
 #%matplotlib inline
 
+import os
+import re
 import time
 import pdb
-import struct
 from datetime import datetime
 #from matplotlib.animation import FuncAnimation
 
@@ -116,11 +117,12 @@ class HeaderTimeHist:
         return f"samples: {self.numSamples}, min: {self.minSampleUnits}, max: {self.maxSampleUnits}, mean: {self.mean}, #overflows: {self.overflows}"
 
 class HeaderRateCounter:
-    def __init__(self, numBuckets, nanosPerBucket, currentIndex, desc=''):
+    def __init__(self, numBuckets, nanosPerBucket, currentIndex, desc='', ewmaPerSecond=0):
         self.numBuckets = numBuckets
         self.nanosPerBucket = nanosPerBucket
         self.currentIndex = currentIndex
         self.description = desc
+        self.ewmaPerSecond = ewmaPerSecond
 
         self.timeUnits = nanosToTimeUnits(self.nanosPerBucket)
 
@@ -137,20 +139,271 @@ class HeaderRateCounter:
         return self.description
     
     def stats(self):
-        return f"currentIndex: {self.currentIndex}"
+        return f"currentIndex: {self.currentIndex}, ewma per second: {self.ewmaPerSecond:.1f}"
     
 
+# layouts of the shm headers, see histProfiler/histogram.h
+histHeaderDtype = np.dtype([('magic', '<u8'), ('numBuckets', '<u8'), ('maxSample', '<u8'),
+                            ('minSample', '<u8'), ('overflows', '<u8'), ('sum', '<u8'),
+                            ('numSamples', '<u8'), ('description', 'S128'), ('xAxisDescription', 'S128')])
+
+exemplarDtype = np.dtype([('value', '<u8'), ('timestampNanos', '<u8'), ('threadId', '<u8'), ('tag', '<u8')])
+
+exemplarsDtype = np.dtype([('capacity', '<u8'), ('size', '<u8'), ('threshold', '<u8'),
+                           ('entries', exemplarDtype, (32,))])
+
+# cost of an empty region of the clock, see histProfiler/overhead.h
+overheadDtype = np.dtype([('clockSource', '<u8'), ('rounds', '<u8'), ('min', '<u8'), ('median', '<u8'),
+                          ('p90', '<u8'), ('p99', '<u8'), ('max', '<u8'), ('subtracted', '<u8')])
+
+timeHistHeaderDtype = np.dtype([('magic', '<u8'), ('samplesPerBucket', '<u8'), ('numBuckets', '<u8'),
+                                ('maxSample', '<u8'), ('minSample', '<u8'), ('overflows', '<u8'),
+                                ('sum', '<u8'), ('numSamples', '<u8'), ('description', 'S128'),
+                                ('exemplars', exemplarsDtype), ('expectedIntervalNanos', '<u8'),
+                                ('correctedOverflows', '<u8'), ('correctedSum', '<u8'), ('correctedNumSamples', '<u8'),
+                                ('samplingRatio', '<u8'), ('samplingBudgetNanos', '<u8'), ('samplingCostNanos', '<u8'),
+                                ('numCalls', '<u8'), ('clockSkews', '<u8'), ('maxClockSkewNanos', '<u8'),
+                                ('overhead', overheadDtype)])
+
+rateResolutionDtype = np.dtype([('nanosPerBucket', '<u8'), ('numBuckets', '<u8'), ('offset', '<u8'),
+                                ('lastEpoch', '<u8'), ('currentIndex', '<u8')])
+
+# see rateCounter in histProfiler/histogram.h, the data holds the ring of numBuckets then the coarser rings
+rateHeaderDtype = np.dtype([('magic', '<u8'), ('nanosPerBucket', '<u8'), ('numBuckets', '<u8'),
+                            ('currentIndex', '<u8'), ('description', 'S128'), ('lastEpoch', '<u8'),
+                            ('ewmaPerSecond', '<f8'), ('ewmaAlpha', '<f8'), ('numCoarser', '<u8'),
+                            ('coarser', rateResolutionDtype, (3,))])
+
+def rateResolution(h, counter):
+    # (nanosPerBucket, numBuckets, offset in the data, lastEpoch, currentIndex) of ring 0 - the first, 1... - the coarser
+    if counter == 0:
+        return (int(h['nanosPerBucket']), int(h['numBuckets']), 0, int(h['lastEpoch']), int(h['currentIndex']))
+    r = h['coarser'][counter - 1]
+    return (int(r['nanosPerBucket']), int(r['numBuckets']), int(r['offset']), int(r['lastEpoch']), int(r['currentIndex']))
+
+# see histProfiler/perfHistogram.h
+perfEventNames = ['none', 'cycles', 'instructions', 'cacheMisses', 'branchMisses', 'contextSwitches', 'taskClock']
+
+perfCounterDtype = np.dtype([('requested', '<u8'), ('opened', '<u8'), ('rdpmc', '<u8'), ('multiplexed', '<u8'),
+                             ('unitsPerBucket', '<u8'), ('maxSample', '<u8'), ('minSample', '<u8'), ('overflows', '<u8'),
+                             ('sum', '<u8'), ('numSamples', '<u8')])
+
+perfHistHeaderDtype = np.dtype([('magic', '<u8'), ('samplesPerBucket', '<u8'), ('numBuckets', '<u8'),
+                                ('maxSample', '<u8'), ('minSample', '<u8'), ('overflows', '<u8'),
+                                ('sum', '<u8'), ('numSamples', '<u8'), ('description', 'S128'),
+                                ('numEvents', '<u8'), ('counters', perfCounterDtype, (4,))])
+
+regionStatsDtype = np.dtype([('maxSample', '<u8'), ('minSample', '<u8'), ('overflows', '<u8'),
+                             ('sum', '<u8'), ('numSamples', '<u8')])
+
+# see histProfiler/cpuTimeHistogram.h, the data holds wall, cpu and off cpu arrays
+cpuTimeHistogramNames = ['wall', 'cpu', 'offCpu']
+
+cpuTimeHistHeaderDtype = np.dtype([('magic', '<u8'), ('samplesPerBucket', '<u8'), ('numBuckets', '<u8'),
+                                   ('description', 'S128'), ('wall', regionStatsDtype),
+                                   ('cpu', regionStatsDtype), ('offCpu', regionStatsDtype)])
+
+# see histProfiler/histogram2d.h, the data is a matrix of x buckets rows by y buckets columns
+axisDtype = np.dtype([('scale', '<u8'), ('unitsPerBucket', '<u8'), ('subBucketBits', '<u8'),
+                      ('numBuckets', '<u8'), ('overflows', '<u8'), ('description', 'S64')])
+
+hist2DHeaderDtype = np.dtype([('magic', '<u8'), ('numSamples', '<u8'), ('description', 'S128'),
+                              ('x', axisDtype), ('y', axisDtype)])
+
+hist2DMagic = 0x0BADBABE00000008
+
+def axisLowerBounds(axis):
+    # the smallest value of every bucket, same as shmAxis::lowerBound
+    units, subBuckets = int(axis['unitsPerBucket']), 1 << int(axis['subBucketBits'])
+    buckets = np.arange(int(axis['numBuckets']), dtype=np.uint64)
+    if int(axis['scale']) == 0:
+        return buckets * units
+    group = np.where(buckets < subBuckets, 0, (buckets - subBuckets) // subBuckets)
+    sub = np.where(buckets < subBuckets, 0, (buckets - subBuckets) % subBuckets)
+    logLinear = ((subBuckets + sub) << group) * units
+    return np.where(buckets < subBuckets, buckets * units, logLinear)
+
+# see histProfiler/ddSketch.h, the data holds maxBuckets counts of the keys [minKey, minKey + maxBuckets)
+sketchHeaderDtype = np.dtype([('magic', '<u8'), ('relativeAccuracy', '<f8'), ('gamma', '<f8'), ('maxBuckets', '<u8'),
+                              ('minKey', '<i8'), ('maxKey', '<i8'), ('zeroCount', '<u8'), ('collapsedKey', '<i8'),
+                              ('collapsed', '<u8'), ('maxSample', '<u8'), ('minSample', '<u8'), ('sum', '<u8'),
+                              ('numSamples', '<u8'), ('description', 'S128')])
+
+sketchMagic = 0x0BADBABE00000009
+
+class MergedSketch:
+    """
+    sum of the sketches of many threads and processes, the counts of every key add up exactly.
+    same as profiler::mergedSketch
+    """
+    def __init__(self, filenames=[]):
+        self.gamma = None
+        self.minKey = 0
+        self.counts = np.zeros(0, dtype=np.uint64)
+        self.zeroCount = 0
+        self.numSamples = 0
+        for filename in filenames:
+            self.merge(filename)
+
+    def merge(self, filename):
+        magic = int(np.memmap(filename, dtype='<u8', mode='r', shape=(1,))[0])
+        if magic != sketchMagic:
+            raise Exception(f"file {filename} has magic {hex(magic)}, it's not a sketch")
+        h = np.memmap(filename, dtype=sketchHeaderDtype, mode='r', shape=(1,))[0]
+        if self.gamma is None:
+            self.gamma = float(h['gamma'])
+        elif float(h['gamma']) != self.gamma:
+            raise Exception(f"file {filename} has gamma {float(h['gamma'])}, can't merge it exactly with {self.gamma}")
+
+        self.zeroCount += int(h['zeroCount'])
+        self.numSamples += int(h['numSamples'])
+        if int(h['numSamples']) == int(h['zeroCount']):
+            return
+        minKey, maxKey = int(h['minKey']), int(h['maxKey'])
+        data = np.memmap(filename, dtype='<u8', mode='r', offset=dataOffset, shape=(maxKey - minKey + 1,))
+        if len(self.counts) == 0:
+            self.minKey = minKey
+        first, last = min(self.minKey, minKey), max(self.minKey + len(self.counts) - 1, maxKey)
+        counts = np.zeros(last - first + 1, dtype=np.uint64)
+        counts[self.minKey - first:self.minKey - first + len(self.counts)] += self.counts
+        counts[minKey - first:maxKey - first + 1] += data
+        self.minKey, self.counts = first, counts
+
+    def values(self):
+        # the value every bucket stands for
+        return 2 * np.power(self.gamma, np.arange(self.minKey, self.minKey + len(self.counts), dtype=np.float64)) / (self.gamma + 1)
+
+    def quantile(self, q):
+        total = self.zeroCount + int(self.counts.sum())
+        if total == 0:
+            return 0
+        rank = int(min(max(q, 0.0), 1.0) * (total - 1))
+        if rank < self.zeroCount:
+            return 0
+        bucket = int(np.searchsorted(np.cumsum(self.counts) + self.zeroCount, rank, side='right'))
+        return float(self.values()[min(bucket, len(self.counts) - 1)])
+
+class SketchVisualiser:
+    """
+    distribution of the merged sketches on a log scale, with its percentiles in the legend
+    """
+    def __init__(self, filenames, color='blue', title='', percentiles=(50, 90, 99, 99.9)):
+        self.filenames = filenames if isinstance(filenames, list) else [filenames]
+        self.color = color
+        self.title = title
+        self.percentiles = percentiles
+        self.tpStart = datetime.now()
+
+    def setup(self, ax, fig):
+        ax.axis('auto')
+
+    def plot(self, ax, fig):
+        merged = MergedSketch(self.filenames)
+        desc = decodeDesc(np.memmap(self.filenames[0], dtype=sketchHeaderDtype, mode='r', shape=(1,))[0]['description'])
+        quantiles = ', '.join(f"p{p}: {merged.quantile(p / 100.0):.0f}" for p in self.percentiles)
+        legend = f"{datetime.now() - self.tpStart} : {desc}\nsamples: {merged.numSamples}, {quantiles}\n{len(self.filenames)} files"
+
+        ax.clear()
+        ax.grid(True)
+        ax.set_xscale('log')
+        ax.set_xlabel("nanoseconds")
+        ax.set_ylabel("#samples")
+        if len(merged.counts) > 0:
+            ax.plot(merged.values(), merged.counts, color=self.color, label=legend)
+            ax.legend(fontsize=10, loc='upper right')
+
+# see histProfiler/heatmap.h, a row is [end of its interval in steady clock nanos, numLatencyBuckets counts]
+heatmapHeaderDtype = np.dtype([('magic', '<u8'), ('nanosPerBucket', '<u8'), ('numBuckets', '<u8'),
+                               ('samplesPerBucket', '<u8'), ('numLatencyBuckets', '<u8'), ('currentIndex', '<u8'),
+                               ('overflows', '<u8'), ('numSamples', '<u8'), ('description', 'S128')])
+
+heatmapMagic = 0x0BADBABE0000000A
+
+# see histProfiler/gauge.h
+gaugeHeaderDtype = np.dtype([('magic', '<u8'), ('last', '<i8'), ('min', '<i8'), ('max', '<i8'), ('numUpdates', '<u8'),
+                             ('timeWeighted', '<u8'), ('firstNanos', '<u8'), ('lastNanos', '<u8'), ('weightedSum', '<f8'),
+                             ('description', 'S128')])
+
+gaugeMagic = 0x0BADBABE0000000C
+
+counterHeaderDtype = np.dtype([('magic', '<u8'), ('value', '<u8'), ('description', 'S128')])
+
+counterMagic = 0x0BADBABE0000000D
+
+# see histProfiler/valueHistogram.h, buckets 0 and numBuckets - 1 are below and above the range
+valueLayoutDtype = np.dtype([('scale', '<u8'), ('offset', '<f8'), ('perUnit', '<f8'), ('subBucketBits', '<u8'),
+                             ('numBuckets', '<u8'), ('zeroBucket', '<u8')])
+
+valueHistHeaderDtype = np.dtype([('magic', '<u8'), ('layout', valueLayoutDtype), ('maxSample', '<f8'),
+                                 ('minSample', '<f8'), ('sum', '<f8'), ('underflows', '<u8'), ('overflows', '<u8'),
+                                 ('numSamples', '<u8'), ('description', 'S128'), ('XAxisDescription', 'S128')])
+
+valueHistMagic = 0x0BADBABE0000000E
+
+def logLinearLowerBounds(buckets, subBucketBits):
+    # same as profiler::logLinearLowerBound
+    subBuckets = 1 << subBucketBits
+    group = np.where(buckets < subBuckets, 0, (buckets - subBuckets) // subBuckets)
+    sub = np.where(buckets < subBuckets, 0, (buckets - subBuckets) % subBuckets)
+    return np.where(buckets < subBuckets, buckets, (subBuckets + sub) << group).astype(np.float64)
+
+def valueLowerBounds(layout):
+    # the smallest value of every bucket, same as shmValueLayout::lowerBound
+    buckets = np.arange(int(layout['numBuckets']), dtype=np.uint64)
+    perUnit = float(layout['perUnit'])
+    if int(layout['scale']) == 0:
+        bounds = float(layout['offset']) + (buckets.astype(np.float64) - 1) / perUnit
+    else:
+        zero, subBucketBits = int(layout['zeroBucket']), int(layout['subBucketBits'])
+        above = logLinearLowerBounds(np.where(buckets > zero, buckets - zero, 0).astype(np.uint64), subBucketBits)
+        below = logLinearLowerBounds(np.where(buckets > zero, 0, zero - buckets + 1).astype(np.uint64), subBucketBits)
+        bounds = np.where(buckets > zero, above, -below) / perUnit
+    bounds[0] = -np.inf
+    return bounds
+
+headerDtypes = {
+    0x0BADBABE00000001: histHeaderDtype,
+    0x0BADBABE00000002: timeHistHeaderDtype,
+    0x0BADBABE00000003: rateHeaderDtype,
+    0x0BADBABE00000006: perfHistHeaderDtype,
+    0x0BADBABE00000007: cpuTimeHistHeaderDtype,
+}
+
+# the data array starts on the page after the header
+dataOffset = 4096
+
+def decodeDesc(raw):
+    return raw.decode('utf-8', errors='replace').partition('\0')[0]
+
 class HistVisualiser:
-    def __init__(self, filename, color='blue', title='', figsize=(20, 5), reset=False):
+    def __init__(self, filename, color='blue', title='', figsize=(20, 5), reset=False, corrected=False, counter=0):
         self.filename = filename
-        self.in_stream = open(filename, "rb")
+        self.magic = self.readFileType()
+        if self.magic not in headerDtypes:
+            raise Exception(f"file {self.filename} has magic {hex(self.magic)}, it's not supported")
+
+        # both maps are views on the page cache, refreshing a plot does not parse or copy anything
+        self.headerMap = np.memmap(filename, dtype=headerDtypes[self.magic], mode='r', shape=(1,))
+        # coordinated omission corrected time histograms keep the corrected array after the raw one
+        self.corrected = corrected and self.magic == 0x0BADBABE00000002 and self.headerMap[0]['expectedIntervalNanos'] > 0
+        # perf histograms keep the time array then one per perf event, counter 0 is the time.
+        # cpu time histograms keep wall, cpu and off cpu
+        self.counter = 0
+        if self.magic == 0x0BADBABE00000006 and counter <= self.headerMap[0]['numEvents']:
+            self.counter = counter
+        elif self.magic == 0x0BADBABE00000007 and counter < len(cpuTimeHistogramNames):
+            self.counter = counter
+        # rate counters keep a ring per resolution, counter 0 is the first one
+        elif self.magic == 0x0BADBABE00000003 and counter <= self.headerMap[0]['numCoarser']:
+            self.counter = counter
         self.headerFull = self.readHeader(True)
-    
-        dataLayout = "<"
-        for _ in range(self.headerFull.getNumBuckets()):
-            dataLayout += 'Q ' 
-        self.dataStruct = struct.Struct(dataLayout)
-        
+        numBuckets = self.headerFull.getNumBuckets()
+        arrayIndex = 1 if self.corrected else self.counter
+        offset = dataOffset + numBuckets * 8 * arrayIndex
+        if self.magic == 0x0BADBABE00000003:
+            offset = dataOffset + rateResolution(self.headerMap[0], self.counter)[2] * 8
+        self.data = np.memmap(filename, dtype='<u8', mode='r', offset=offset, shape=(numBuckets,))
+
         self.color = color
         self.title = title
         self.figsize = figsize
@@ -158,87 +411,80 @@ class HistVisualiser:
         self.resetData = None
 
         if self.reset:
-            self.in_stream.seek(4096, 0)
-            buffer = self.in_stream.read(self.dataStruct.size)
-            self.resetData = dataStruct.unpack(buffer)
+            self.resetData = np.array(self.data)
 
         self.tpStart = datetime.now()
 
     def readFileType(self):
-        magicLayout = "<Q"
-        headerStruct = struct.Struct(magicLayout)
-
-        self.in_stream.seek(0, 0)
-        unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-
-        return unpacked[0]
+        return int(np.memmap(self.filename, dtype='<u8', mode='r', shape=(1,))[0])
 
     def readHeader(self, full):
-        magic = self.readFileType()
-
-        if magic == 0x0BADBABE00000001:
-            if full:
-                headerFullLayout = "<Q Q Q Q Q Q Q 128s 128s"
-                headerStruct = struct.Struct(headerFullLayout)
-                self.in_stream.seek(0, 0)
-                unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-                return HeaderHist(numBuckets=unpacked[1], numSamples=unpacked[6], 
-                              minSample=unpacked[3], maxSample=unpacked[2], overflows=unpacked[4], 
-                              sum_=unpacked[5], desc=unpacked[7].decode('utf-8').partition('\0')[0],
-                              xAxisDesc=unpacked[8].decode('utf-8').partition('\0')[0])
-            else:
-                headerLayout     = "<Q Q Q Q Q Q Q"
-                headerStruct = struct.Struct(headerLayout)
-                self.in_stream.seek(0, 0)
-                unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-                return HeaderHist(numBuckets=unpacked[1], numSamples=unpacked[6], 
-                              minSample=unpacked[3], maxSample=unpacked[2], overflows=unpacked[4], 
-                              sum_=unpacked[5])
-            
-
-        elif magic == 0x0BADBABE00000002:
-            if full:
-                headerFullLayout = "<Q Q Q Q Q Q Q Q 128s"
-                headerStruct = struct.Struct(headerFullLayout)
-                self.in_stream.seek(0, 0)
-                unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-                return HeaderTimeHist(numBuckets=unpacked[2], numSamples=unpacked[7], 
-                              samplesPerBucket=unpacked[1], minSample=unpacked[4], 
-                              maxSample=unpacked[3], overflows=unpacked[5], 
-                              sum_=unpacked[6], desc=unpacked[8].decode('utf-8').partition('\0')[0])
-            else:
-                headerLayout     = "<Q Q Q Q Q Q Q Q"
-                headerStruct = struct.Struct(headerLayout)
-                self.in_stream.seek(0, 0)
-                unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-                return HeaderTimeHist(numBuckets=unpacked[2], numSamples=unpacked[7], 
-                              samplesPerBucket=unpacked[1], minSample=unpacked[4], 
-                              maxSample=unpacked[3], overflows=unpacked[5], 
-                              sum_=unpacked[6])
-        elif magic == 0x0BADBABE00000003:
-            if full:
-                headerFullLayout = "<Q Q Q Q 128s"
-                headerStruct = struct.Struct(headerFullLayout)
-                self.in_stream.seek(0, 0)
-                unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-                return HeaderRateCounter(numBuckets=unpacked[2], nanosPerBucket=unpacked[1], 
-                              currentIndex=unpacked[3], 
-                              desc=unpacked[4].decode('utf-8').partition('\0')[0])
-            else:
-                headerLayout     = "<Q Q Q Q"
-                headerStruct = struct.Struct(headerLayout)
-                self.in_stream.seek(0, 0)
-                unpacked = headerStruct.unpack(self.in_stream.read(headerStruct.size))
-                return HeaderRateCounter(numBuckets=unpacked[2], nanosPerBucket=unpacked[1], 
-                              currentIndex=unpacked[3])
+        h = self.headerMap[0]
+
+        if self.magic == 0x0BADBABE00000001:
+            return HeaderHist(numBuckets=int(h['numBuckets']), numSamples=int(h['numSamples']),
+                              minSample=int(h['minSample']), maxSample=int(h['maxSample']),
+                              overflows=int(h['overflows']), sum_=int(h['sum']),
+                              desc=decodeDesc(h['description']) if full else '',
+                              xAxisDesc=decodeDesc(h['xAxisDescription']) if full else '')
+        elif self.magic == 0x0BADBABE00000006 and self.counter > 0:
+            c = h['counters'][self.counter - 1]
+            event = perfEventNames[int(c['opened'])] if int(c['opened']) < len(perfEventNames) else 'unknown'
+            return HeaderHist(numBuckets=int(h['numBuckets']), numSamples=int(c['numSamples']),
+                              minSample=int(c['minSample']), maxSample=int(c['maxSample']),
+                              overflows=int(c['overflows']), sum_=int(c['sum']),
+                              desc=decodeDesc(h['description']) if full else '',
+                              xAxisDesc=f"{int(c['unitsPerBucket'])} {event} per bucket" if full else '')
+        elif self.magic == 0x0BADBABE00000006:
+            return HeaderTimeHist(numBuckets=int(h['numBuckets']), numSamples=int(h['numSamples']),
+                              samplesPerBucket=int(h['samplesPerBucket']), minSample=int(h['minSample']),
+                              maxSample=int(h['maxSample']), overflows=int(h['overflows']), sum_=int(h['sum']),
+                              desc=decodeDesc(h['description']) if full else '')
+        elif self.magic == 0x0BADBABE00000007:
+            s = h[cpuTimeHistogramNames[self.counter]]
+            return HeaderTimeHist(numBuckets=int(h['numBuckets']), numSamples=int(s['numSamples']),
+                              samplesPerBucket=int(h['samplesPerBucket']), minSample=int(s['minSample']),
+                              maxSample=int(s['maxSample']), overflows=int(s['overflows']), sum_=int(s['sum']),
+                              desc=f"{decodeDesc(h['description'])} - {cpuTimeHistogramNames[self.counter]}" if full else '')
+        elif self.magic == 0x0BADBABE00000002:
+            return HeaderTimeHist(numBuckets=int(h['numBuckets']),
+                              numSamples=int(h['correctedNumSamples'] if self.corrected else h['numSamples']),
+                              samplesPerBucket=int(h['samplesPerBucket']), minSample=int(h['minSample']),
+                              maxSample=int(h['maxSample']),
+                              overflows=int(h['correctedOverflows'] if self.corrected else h['overflows']),
+                              sum_=int(h['correctedSum'] if self.corrected else h['sum']),
+                              desc=decodeDesc(h['description']) if full else '')
         else:
-            raise Exception(f"file {self.filename} has magic {hex(magic)}, it's not supported")
-    
+            nanosPerBucket, numBuckets, _, _, currentIndex = rateResolution(h, self.counter)
+            return HeaderRateCounter(numBuckets=numBuckets, nanosPerBucket=nanosPerBucket,
+                              currentIndex=currentIndex, ewmaPerSecond=float(h['ewmaPerSecond']),
+                              desc=decodeDesc(h['description']) if full else '')
+
     def readData(self):
-        self.in_stream.seek(4096, 0)
-        buffer = self.in_stream.read(self.dataStruct.size)
-        return self.dataStruct.unpack(buffer)
-    
+        if self.magic == 0x0BADBABE00000003:
+            return self.readRates()
+        return self.data
+
+    def readRates(self):
+        # buckets of epochs older than a lap of now are stale, the thread went idle and didn't clear them
+        nanosPerBucket, numBuckets, _, lastEpoch, _ = rateResolution(self.headerMap[0], self.counter)
+        nowEpoch = time.monotonic_ns() // nanosPerBucket
+        if nowEpoch - lastEpoch >= numBuckets:
+            return np.zeros(numBuckets, dtype=np.uint64)
+        stale = [(lastEpoch + k) % numBuckets for k in range(1, nowEpoch - lastEpoch + 1)]
+        if not stale:
+            return self.data
+        data = np.array(self.data)
+        data[stale] = 0
+        return data
+
+    def samplingScale(self):
+        if self.magic != 0x0BADBABE00000002:
+            return 1
+        h = self.headerMap[0]
+        numSamples, numCalls = int(h['numSamples']), int(h['numCalls'])
+        return numCalls / numSamples if numSamples > 0 and numCalls > numSamples else 1
+
     def setup(self, ax, fig):
         ax.axis('auto')
         
@@ -249,7 +495,12 @@ class HistVisualiser:
 
         data = self.readData()
         if self.reset:
-            data = [x - y for x, y in zip(data, self.resetData)]
+            data = data - self.resetData
+
+        # sampled time histograms record 1 in samplingRatio calls, scale back to all the calls
+        scale = self.samplingScale()
+        if scale != 1:
+            data = data * scale
         
         legend = f"{datetime.now() - self.tpStart} : {self.headerFull.description}\n{header.stats()}\n{self.filename}"
 
@@ -266,6 +517,269 @@ class HistVisualiser:
         plot, = ax.plot(data, color=self.color, label=legend)
         ax.legend(fontsize=10, loc='upper right')
    
+class Hist2DVisualiser:
+    """
+    heatmap of a 2-D histogram, the x buckets are the rows, the colour is log10 of the count,
+    with the percentiles of y of every row on top
+    """
+    def __init__(self, filename, title='', percentiles=(50, 90, 99)):
+        self.filename = filename
+        magic = int(np.memmap(filename, dtype='<u8', mode='r', shape=(1,))[0])
+        if magic != hist2DMagic:
+            raise Exception(f"file {self.filename} has magic {hex(magic)}, it's not a 2-D histogram")
+
+        self.headerMap = np.memmap(filename, dtype=hist2DHeaderDtype, mode='r', shape=(1,))
+        h = self.headerMap[0]
+        self.rows, self.columns = int(h['x']['numBuckets']), int(h['y']['numBuckets'])
+        self.data = np.memmap(filename, dtype='<u8', mode='r', offset=dataOffset, shape=(self.rows, self.columns))
+        self.xBounds = axisLowerBounds(h['x'])
+        self.yBounds = axisLowerBounds(h['y'])
+        self.title = title
+        self.percentiles = percentiles
+        self.tpStart = datetime.now()
+
+    def rowPercentiles(self, percentiles=None):
+        """
+        {x lower bound: [y lower bound of each percentile]} of the rows with samples
+        """
+        percentiles = self.percentiles if percentiles is None else percentiles
+        counts = np.array(self.data)
+        result = {}
+        for row in range(self.rows):
+            total = int(counts[row].sum())
+            if total == 0:
+                continue
+            cumulative = np.cumsum(counts[row])
+            columns = [int(np.searchsorted(cumulative, total * p / 100.0)) for p in percentiles]
+            result[int(self.xBounds[row])] = [int(self.yBounds[min(c, self.columns - 1)]) for c in columns]
+        return result
+
+    def setup(self, ax, fig):
+        ax.axis('auto')
+
+    def plot(self, ax, fig):
+        h = self.headerMap[0]
+        counts = np.array(self.data)
+        used = np.nonzero(counts.sum(axis=1))[0]
+
+        ax.clear()
+        if len(used) == 0:
+            ax.set_title(f"{decodeDesc(h['description'])} - no samples")
+            return
+
+        first, last = int(used[0]), int(used[-1]) + 1
+        lastColumn = int(np.nonzero(counts[first:last].sum(axis=0))[0][-1]) + 1
+        ax.imshow(np.log10(counts[first:last, :lastColumn] + 1), aspect='auto', origin='lower', cmap='viridis',
+                  extent=(0, lastColumn, first, last))
+
+        rowPercentiles = self.rowPercentiles()
+        for i, p in enumerate(self.percentiles):
+            rows = [row for row in range(first, last) if int(self.xBounds[row]) in rowPercentiles]
+            columns = [np.searchsorted(self.yBounds, rowPercentiles[int(self.xBounds[row])][i], side='right') - 0.5 for row in rows]
+            ax.plot(columns, np.array(rows) + 0.5, label=f"p{p}")
+
+        ax.set_xlabel(f"{decodeDesc(h['y']['description'])}, {int(h['y']['unitsPerBucket'])} per unit")
+        ax.set_ylabel(f"{decodeDesc(h['x']['description'])} bucket")
+        ax.set_title(f"{datetime.now() - self.tpStart} : {decodeDesc(h['description'])}, samples: {int(h['numSamples'])}, "
+                     f"overflows x: {int(h['x']['overflows'])}, y: {int(h['y']['overflows'])}", fontsize=10)
+        ax.legend(fontsize=10, loc='upper right')
+
+class HeatmapVisualiser:
+    """
+    the latency distribution of the last intervals of a heatmap, oldest at the bottom
+    """
+    def __init__(self, filename, intervals=60, title=''):
+        self.filename = filename
+        magic = int(np.memmap(filename, dtype='<u8', mode='r', shape=(1,))[0])
+        if magic != heatmapMagic:
+            raise Exception(f"file {self.filename} has magic {hex(magic)}, it's not a heatmap")
+
+        self.headerMap = np.memmap(filename, dtype=heatmapHeaderDtype, mode='r', shape=(1,))
+        h = self.headerMap[0]
+        self.rows, self.columns = int(h['numBuckets']), int(h['numLatencyBuckets'])
+        self.nanosPerBucket = int(h['nanosPerBucket'])
+        self.data = np.memmap(filename, dtype='<u8', mode='r', offset=dataOffset, shape=(self.rows, self.columns + 1))
+        self.intervals = min(intervals, self.rows)
+        self.title = title
+        self.tpStart = datetime.now()
+
+    def lastIntervals(self, n=None):
+        """
+        [(interval ends, counts)] views on the ring, oldest first, no copies.
+        rows of intervals without samples still hold an older interval, current() tells them apart
+        """
+        n = self.intervals if n is None else min(n, self.rows)
+        current = int(self.headerMap[0]['currentIndex'])
+        newer = self.data[max(current + 1 - n, 0):current + 1]
+        segments = [newer]
+        if n > current + 1:
+            segments.insert(0, self.data[self.rows - (n - current - 1):])
+        return [(segment[:, 0], segment[:, 1:]) for segment in segments]
+
+    def current(self, ends):
+        # True for the rows of the last numBuckets intervals.
+        # the ends are read before the counts they mask, on x86-64 loads are not reordered, that is the acquire of rowEnd
+        currentEnd = int(self.data[int(self.headerMap[0]['currentIndex'])][0])
+        return (ends > 0) & (ends + self.rows * self.nanosPerBucket > currentEnd)
+
+    def setup(self, ax, fig):
+        ax.axis('auto')
+
+    def plot(self, ax, fig):
+        h = self.headerMap[0]
+        ax.clear()
+        row = 0
+        for ends, counts in self.lastIntervals():
+            # stale rows are drawn empty
+            image = np.log10(counts * self.current(ends)[:, None] + 1)
+            ax.imshow(image, aspect='auto', origin='lower', cmap='viridis',
+                      extent=(0, self.columns, row, row + len(ends)))
+            row += len(ends)
+        ax.set_ylim(0, max(row, 1))
+        ax.set_xlim(0, self.columns)
+        ax.set_xlabel(nanosToTimeUnits(int(h['samplesPerBucket'])))
+        ax.set_ylabel(f"intervals of {nanosToTimeUnits(self.nanosPerBucket).replace(' per bucket', '')}")
+        ax.set_title(f"{datetime.now() - self.tpStart} : {decodeDesc(h['description'])}, samples: {int(h['numSamples'])}, "
+                     f"overflows: {int(h['overflows'])}", fontsize=10)
+
+def timeWeightedMean(h, nowNanos):
+    # the last value counts until now, steady clock nanos are CLOCK_MONOTONIC like time.monotonic_ns()
+    if int(h['numUpdates']) == 0 or nowNanos <= int(h['firstNanos']):
+        return float(h['last'])
+    weightedSum = float(h['weightedSum']) + float(h['last']) * (nowNanos - min(int(h['lastNanos']), nowNanos))
+    return weightedSum / (nowNanos - int(h['firstNanos']))
+
+class GaugeVisualiser:
+    """
+    the last value of a gauge every time it's plotted, min, max and the time weighted mean in the legend
+    """
+    def __init__(self, filename, color='blue', title='', history=600):
+        self.filename = filename
+        magic = int(np.memmap(filename, dtype='<u8', mode='r', shape=(1,))[0])
+        if magic != gaugeMagic:
+            raise Exception(f"file {self.filename} has magic {hex(magic)}, it's not a gauge")
+
+        self.headerMap = np.memmap(filename, dtype=gaugeHeaderDtype, mode='r', shape=(1,))
+        self.color = color
+        self.title = title
+        self.history = history
+        self.times = []
+        self.values = []
+        self.tpStart = datetime.now()
+
+    def setup(self, ax, fig):
+        ax.axis('auto')
+
+    def plot(self, ax, fig):
+        h = self.headerMap[0]
+        self.times.append((datetime.now() - self.tpStart).total_seconds())
+        self.values.append(int(h['last']))
+        self.times, self.values = self.times[-self.history:], self.values[-self.history:]
+
+        legend = f"{decodeDesc(h['description'])}\nlast: {int(h['last'])}, min: {int(h['min'])}, max: {int(h['max'])}, " \
+                 f"updates: {int(h['numUpdates'])}"
+        if int(h['timeWeighted']):
+            legend += f", time weighted mean: {timeWeightedMean(h, time.monotonic_ns()):.2f}"
+
+        ax.clear()
+        ax.grid(True)
+        ax.set_xlabel("seconds")
+        ax.step(self.times, self.values, where='post', color=self.color, label=legend)
+        ax.legend(fontsize=10, loc='upper right')
+
+def counterFiles(directory, id):
+    # the shards shmFile_<id>_<pid>_<n>.shm of a counter, same as profiler::counterTotal
+    pattern = re.compile(rf"shmFile_{re.escape(id)}_\d+_\d+\.shm")
+    return [os.path.join(directory, f) for f in sorted(os.listdir(directory)) if pattern.fullmatch(f)]
+
+def counterTotal(filenames):
+    total = 0
+    for filename in filenames:
+        h = np.memmap(filename, dtype=counterHeaderDtype, mode='r', shape=(1,))[0]
+        if int(h['magic']) == counterMagic:
+            total += int(h['value'])
+    return total
+
+class CounterVisualiser:
+    """
+    the sum of the shards of a counter and its rate per second between plots,
+    shards of threads started after the visualiser are picked up on every plot
+    """
+    def __init__(self, directory, id, color='blue', title='', history=600):
+        self.directory = directory
+        self.id = id
+        self.color = color
+        self.title = title
+        self.history = history
+        self.times = []
+        self.rates = []
+        self.last = None
+        self.tpStart = datetime.now()
+
+    def setup(self, ax, fig):
+        ax.axis('auto')
+
+    def plot(self, ax, fig):
+        files = counterFiles(self.directory, self.id)
+        total = counterTotal(files)
+        now = time.monotonic()
+        if self.last is not None and now > self.last[0]:
+            self.times.append((datetime.now() - self.tpStart).total_seconds())
+            self.rates.append((total - self.last[1]) / (now - self.last[0]))
+            self.times, self.rates = self.times[-self.history:], self.rates[-self.history:]
+        self.last = (now, total)
+
+        ax.clear()
+        ax.grid(True)
+        ax.set_xlabel("seconds")
+        ax.set_ylabel("per second")
+        ax.plot(self.times, self.rates, color=self.color, label=f"{self.id}: {total}, {len(files)} shards")
+        ax.legend(fontsize=10, loc='upper right')
+
+class ValueHistVisualiser:
+    """
+    buckets of a value histogram with samples, negative values on the left, under and overflows in the legend
+    """
+    def __init__(self, filename, color='blue', title=''):
+        self.filename = filename
+        magic = int(np.memmap(filename, dtype='<u8', mode='r', shape=(1,))[0])
+        if magic != valueHistMagic:
+            raise Exception(f"file {self.filename} has magic {hex(magic)}, it's not a value histogram")
+
+        self.headerMap = np.memmap(filename, dtype=valueHistHeaderDtype, mode='r', shape=(1,))
+        h = self.headerMap[0]
+        self.data = np.memmap(filename, dtype='<u8', mode='r', offset=dataOffset, shape=(int(h['layout']['numBuckets']),))
+        self.bounds = valueLowerBounds(h['layout'])
+        self.color = color
+        self.title = title
+        self.tpStart = datetime.now()
+
+    def setup(self, ax, fig):
+        ax.axis('auto')
+
+    def plot(self, ax, fig):
+        h = self.headerMap[0]
+        counts = np.array(self.data)
+        numSamples = int(h['numSamples'])
+        legend = f"{datetime.now() - self.tpStart} : {decodeDesc(h['description'])}\nsamples: {numSamples}"
+        if numSamples > 0:
+            legend += f", min: {float(h['minSample']):g}, max: {float(h['maxSample']):g}, mean: {float(h['sum']) / numSamples:g}"
+        legend += f"\nunderflows: {int(h['underflows'])}, overflows: {int(h['overflows'])}"
+
+        ax.clear()
+        ax.grid(True)
+        ax.set_xlabel(decodeDesc(h['XAxisDescription']))
+        ax.set_ylabel("#samples")
+        # the range without the buckets below and above it, which have no finite bounds
+        inner = slice(1, len(counts) - 1)
+        used = np.nonzero(counts[inner])[0]
+        if len(used) > 0:
+            first, last = int(used[0]) + 1, int(used[-1]) + 2
+            ax.step(self.bounds[first:last], counts[first:last], where='post', color=self.color, label=legend)
+            ax.legend(fontsize=10, loc='upper right')
+        else:
+            ax.set_title(legend, fontsize=10)
+
 class HistVisualiserLayout():
     def __init__(self, histVisualisers=[], figsize=(12, 7)):
         self.histVisualisers = histVisualisers
@@ -0,0 +1,34 @@
+# cmake -DNM=<nm> -DOBJECT=<codegen_profiled object> -P checkCodegen.cmake
+# fails when a profiled_* function is larger than its direct_* twin
+
+execute_process(COMMAND ${NM} -S -C --defined-only ${OBJECT}
+				OUTPUT_VARIABLE symbols
+				RESULT_VARIABLE rc)
+if (NOT rc EQUAL 0)
+	message(FATAL_ERROR "${NM} failed on ${OBJECT}")
+endif()
+
+string(REPLACE "\n" ";" lines "${symbols}")
+set(checked 0)
+foreach (line IN LISTS lines)
+	if (line MATCHES "^[0-9a-f]+ ([0-9a-f]+) [Tt] (profiled|direct)_([A-Za-z]+)")
+		set(size_${CMAKE_MATCH_2}_${CMAKE_MATCH_3} ${CMAKE_MATCH_1})
+		list(APPEND names ${CMAKE_MATCH_3})
+	endif()
+endforeach()
+
+list(REMOVE_DUPLICATES names)
+foreach (name IN LISTS names)
+	if (NOT DEFINED size_direct_${name} OR NOT DEFINED size_profiled_${name})
+		message(FATAL_ERROR "missing direct_${name} or profiled_${name} in ${OBJECT}")
+	endif()
+	message(STATUS "${name}: direct 0x${size_direct_${name}} bytes, profiled 0x${size_profiled_${name}} bytes")
+	if (NOT size_direct_${name} STREQUAL size_profiled_${name})
+		message(FATAL_ERROR "profiled_${name} differs from direct_${name}")
+	endif()
+	math(EXPR checked "${checked} + 1")
+endforeach()
+
+if (checked EQUAL 0)
+	message(FATAL_ERROR "no functions checked in ${OBJECT}")
+endif()
@@ -0,0 +1,39 @@
+/*
+	compiled with the profiler disabled, checkCodegen.cmake verifies that
+	every profiled_* function has the same size as its direct_* twin
+*/
+#undef ENABLE_HIST_PROFILER
+#include "profilerApi.h"
+
+#include <memory>
+
+int work(int l, int r);
+void sink(int value);
+std::unique_ptr<int> moveOnly(std::unique_ptr<int> value);
+
+extern "C" int direct_value(int l, int r)
+{
+	return work(l, r);
+}
+extern "C" int profiled_value(int l, int r)
+{
+	return HistProfiled(codegenValue, 1000, 100, "value", work, l, r);
+}
+
+extern "C" void direct_void(int value)
+{
+	sink(value);
+}
+extern "C" void profiled_void(int value)
+{
+	HistProfiled(codegenVoid, 1000, 100, "void", sink, value);
+}
+
+std::unique_ptr<int> direct_moveOnly(std::unique_ptr<int> value)
+{
+	return moveOnly(std::move(value));
+}
+std::unique_ptr<int> profiled_moveOnly(std::unique_ptr<int> value)
+{
+	return HistProfiled(codegenMoveOnly, 1000, 100, "move only", moveOnly, std::move(value));
+}
@@ -0,0 +1,145 @@
+#include "profilerApi.h"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t numWaves{5};
+constexpr size_t threadsPerWave{4};
+constexpr size_t samplesPerThread{100};
+
+std::vector<std::filesystem::path> filesOf(const std::string& id)
+{
+	std::vector<std::filesystem::path> files;
+	for (const auto& entry : std::filesystem::directory_iterator{"."})
+	{
+		if (entry.path().filename().string().rfind("shmFile_" + id + "_", 0) == 0)
+			files.push_back(entry.path());
+	}
+	return files;
+}
+
+void worker()
+{
+	ThreadLocalHistFolded(foldedSizes, 10, "items", "folded histogram");
+	ThreadLocalTimeHistFolded(foldedTasks, 1000, 100, "folded time histogram");
+	for (size_t i = 0; i < samplesPerThread; ++i)
+	{
+		SampleHist(foldedSizes, i % 20); // 9 - 19 are in the overflow bucket
+		TimeHistBegin(foldedTasks);
+		TimeHistEnd(foldedTasks);
+	}
+}
+
+// 1 in samplingRatio regions measured, with the largest regions kept as exemplars
+void sampledWorker(uint64_t samplingRatio)
+{
+	static profiler::metricSite site{"foldedSampled", "folded sampled time histogram", profiler::metricKind::timeHistogram};
+	thread_local profiler::foldOnExit<profiler::timeHistogram> hist{site, 1000, 100, "foldedSampled", profiler::pooled,
+		"folded sampled time histogram", 4, 0, samplingRatio};
+	for (size_t i = 0; i < 10 * samplesPerThread; ++i)
+	{
+		TimeHistBegin(hist);
+		TimeHistEnd(hist);
+	}
+}
+
+}
+
+// the aggregate estimates all the calls of threads sampled at different ratios and is not sampled itself
+int testSampled()
+{
+	for (const auto& file : filesOf("foldedSampled"))
+		std::filesystem::remove(file);
+	for (const uint64_t samplingRatio : {10, 1})
+		std::thread{sampledWorker, samplingRatio}.join();
+
+	profiler::shmFile<profiler::shmTimeHistHeader, uint64_t> sampled{"shmFile_foldedSampled_0.shm"};
+	const auto& header{sampled.header()};
+	std::cout << header << std::endl;
+	uint64_t estimated{0};
+	for (const auto* bucket{sampled.data()}; bucket != sampled.endData(); ++bucket)
+		estimated += *bucket;
+	constexpr auto numCalls{2 * 10 * samplesPerThread};
+	if (header._samplingRatio != 1 || header._numCalls != numCalls || estimated < numCalls * 9 / 10 || estimated > numCalls * 11 / 10
+		|| header._numSamples < numCalls * 9 / 10 || header._numSamples > numCalls * 11 / 10)
+	{
+		std::cerr << "unexpected estimate of the sampled aggregate" << std::endl;
+		return 1;
+	}
+	if (header._exemplars._size == 0 || header._exemplars._size > header._exemplars._capacity)
+	{
+		std::cerr << "unexpected exemplars of the sampled aggregate" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	for (const auto* id : {"foldedSizes", "foldedTasks"})
+	{
+		for (const auto& file : filesOf(id))
+			std::filesystem::remove(file);
+	}
+
+	// a pool that goes away and comes back, the exited threads leave their files to the next ones
+	for (size_t wave = 0; wave < numWaves; ++wave)
+	{
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < threadsPerWave; ++t)
+			threads.emplace_back(worker);
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	constexpr auto numThreads{numWaves * threadsPerWave};
+	for (const auto* id : {"foldedSizes", "foldedTasks"})
+	{
+		const auto files{filesOf(id)};
+		if (files.size() != threadsPerWave + 1)
+		{
+			std::cerr << id << ": " << files.size() << " files instead of a file per thread alive at once and the aggregate" << std::endl;
+			return 1;
+		}
+	}
+
+	profiler::shmFile<profiler::shmHistHeader, uint64_t> sizes{"shmFile_foldedSizes_0.shm"};
+	std::cout << sizes.header() << std::endl;
+	if (sizes.header()._numSamples != numThreads * samplesPerThread || sizes.header()._overfows != numThreads * samplesPerThread * 11 / 20
+		|| sizes.header()._maxSample != 19 || sizes.header()._minSample != 0)
+	{
+		std::cerr << "unexpected stats of the aggregate" << std::endl;
+		return 1;
+	}
+	for (size_t bucket = 0; bucket < 9; ++bucket)
+	{
+		if (sizes.data()[bucket] != numThreads * samplesPerThread / 20)
+		{
+			std::cerr << "unexpected count of bucket " << bucket << " of the aggregate" << std::endl;
+			return 1;
+		}
+	}
+	if (sizes.data()[9] != numThreads * samplesPerThread * 11 / 20)
+	{
+		std::cerr << "unexpected overflow bucket of the aggregate" << std::endl;
+		return 1;
+	}
+
+	profiler::shmFile<profiler::shmTimeHistHeader, uint64_t> tasks{"shmFile_foldedTasks_0.shm"};
+	std::cout << tasks.header() << std::endl;
+	uint64_t taskSamples{0};
+	for (const auto* bucket{tasks.data()}; bucket != tasks.endData(); ++bucket)
+		taskSamples += *bucket;
+	if (tasks.header()._numSamples != numThreads * samplesPerThread || taskSamples != numThreads * samplesPerThread)
+	{
+		std::cerr << "unexpected samples of the time aggregate" << std::endl;
+		return 1;
+	}
+	return testSampled();
+}
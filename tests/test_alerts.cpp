@@ -0,0 +1,176 @@
+#include "profilerApi.h"
+#include "alerts.h"
+
+#include <filesystem>
+#include <iostream>
+
+namespace
+{
+
+constexpr uint64_t second{1'000'000'000};
+const std::filesystem::path dumpDir{"alertDumps"};
+
+size_t numDumps()
+{
+	size_t num{0};
+	for (const auto& entry : std::filesystem::directory_iterator{dumpDir})
+	{
+		if (entry.path().filename().string().rfind("alert_", 0) == 0)
+			++num;
+	}
+	return num;
+}
+
+}
+
+int testPercentile()
+{
+	// 100 buckets of a micro
+	profiler::timeHistogram tasks{1000, 100, "alertTasks", 1, "tasks"};
+	profiler::histogram sizes{10, "alertSizes", 1, "items", "sizes"};
+
+	profiler::alertEngine engine{".", dumpDir};
+	engine.add(profiler::parseAlertRule("slowTasks shmFile_alertTasks_1.shm p99 20000 3"));
+	engine.add(profiler::parseAlertRule("medianTasks shmFile_alertTasks_1.shm p50 20000"));
+	engine.add(profiler::parseAlertRule("bigSizes shmFile_alertSizes_1.shm overflows 50"));
+
+	// recorded before the first window, a baseline that doesn't fire
+	for (size_t i = 0; i < 1000; ++i)
+		tasks.sample(90'000);
+	uint64_t now{1000 * second};
+	if (!engine.evaluate(now).empty())
+	{
+		std::cerr << "fired on the baseline" << std::endl;
+		return 1;
+	}
+
+	// 2% of the tasks above 50 micros: p99 is high, p50 is not
+	const auto slowWindow{[&tasks]()
+	{
+		for (size_t i = 0; i < 98; ++i)
+			tasks.sample(5'000);
+		for (size_t i = 0; i < 2; ++i)
+			tasks.sample(50'000);
+	}};
+	for (size_t window = 0; window < 2; ++window)
+	{
+		slowWindow();
+		if (!engine.evaluate(now += second).empty())
+		{
+			std::cerr << "fired before 3 windows" << std::endl;
+			return 1;
+		}
+	}
+	slowWindow();
+	const auto fired{engine.evaluate(now += second)};
+	if (fired.size() != 1 || fired[0]._rule->_name != "slowTasks" || fired[0]._value != 50'000 || fired[0]._dump.empty())
+	{
+		std::cerr << "p99 didn't fire" << std::endl;
+		return 1;
+	}
+	if (!std::filesystem::exists(fired[0]._dump / "shmFile_alertTasks_1.shm")
+		|| !std::filesystem::exists(fired[0]._dump / "shmFile_alertSizes_1.shm")
+		|| !std::filesystem::exists(fired[0]._dump / "alert.txt"))
+	{
+		std::cerr << "incomplete dump " << fired[0]._dump << std::endl;
+		return 1;
+	}
+
+	// still above, it fired already; a quiet window rearms it
+	slowWindow();
+	if (!engine.evaluate(now += second).empty() || !engine.evaluate(now += second).empty())
+	{
+		std::cerr << "fired twice in a row" << std::endl;
+		return 1;
+	}
+
+	// 100 overflows in half a second
+	for (size_t i = 0; i < 100; ++i)
+		sizes.sample(100);
+	const auto overflows{engine.evaluate(now += second / 2)};
+	if (overflows.size() != 1 || overflows[0]._rule->_name != "bigSizes" || overflows[0]._value != 200)
+	{
+		std::cerr << "overflow rate didn't fire" << std::endl;
+		return 1;
+	}
+	if (numDumps() != 2)
+	{
+		std::cerr << "unexpected number of dumps" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// the process starts over while the sidecar watches: smaller files, files being written, files of another kind
+int testRestart()
+{
+	profiler::alertEngine engine{".", dumpDir};
+	engine.add(profiler::parseAlertRule("restartedTasks shmFile_alertRestart_1.shm samples 100"));
+	engine.add(profiler::parseAlertRule("notAHistogram shmFile_alertGauge_1.shm samples 100"));
+	engine.add(profiler::parseAlertRule("missing shmFile_alertMissing_1.shm samples 100"));
+	profiler::gauge notAHistogram{false, "alertGauge", 1, "not a histogram"};
+
+	uint64_t now{1000 * second};
+	{
+		profiler::timeHistogram tasks{1000, 1000, "alertRestart", 1, "before the restart"};
+		engine.evaluate(now);
+	}
+
+	// the same file truncated to fewer buckets, then a header page of zeros
+	profiler::timeHistogram tasks{1000, 10, "alertRestart", 1, "after the restart"};
+	for (size_t i = 0; i < 1000; ++i)
+		tasks.sample(1000);
+	if (!engine.evaluate(now += second).empty())
+	{
+		std::cerr << "fired on the baseline of the new file" << std::endl;
+		return 1;
+	}
+	const auto magic{tasks._shmHist.header()._magic};
+	tasks._shmHist.header()._magic = 0;
+	if (!engine.evaluate(now += second).empty())
+	{
+		std::cerr << "fired on a file being written" << std::endl;
+		return 1;
+	}
+	tasks._shmHist.header()._magic = magic;
+	engine.evaluate(now += second);
+
+	for (size_t i = 0; i < 1000; ++i)
+		tasks.sample(1000);
+	const auto fired{engine.evaluate(now += second)};
+	if (fired.size() != 1 || fired[0]._rule->_name != "restartedTasks" || fired[0]._value != 1000)
+	{
+		std::cerr << "didn't fire after the restart" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testRules()
+{
+	const auto rule{profiler::parseAlertRule("tail shmFile_x_1.shm p99.9 2000000 3")};
+	if (rule._signal != profiler::alertSignal::percentile || rule._percentile != 99.9 || rule._threshold != 2'000'000 || rule._windows != 3)
+	{
+		std::cerr << "unexpected rule " << rule << std::endl;
+		return 1;
+	}
+	for (const auto* invalid : {"tail shmFile_x_1.shm p100 10", "tail shmFile_x_1.shm max 10", "tail shmFile_x_1.shm"})
+	{
+		try
+		{
+			profiler::parseAlertRule(invalid);
+			std::cerr << "accepted " << invalid << std::endl;
+			return 1;
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	std::filesystem::remove_all(dumpDir);
+	return testRules() + testPercentile() + testRestart();
+}
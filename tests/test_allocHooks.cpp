@@ -0,0 +1,101 @@
+#include "profilerApi.h"
+#include "allocHooks.h"
+
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+
+int testSizes()
+{
+	auto* metrics{profiler::threadAllocMetrics()};
+	if (metrics == nullptr)
+	{
+		std::cerr << "hooks are not recording" << std::endl;
+		return 1;
+	}
+	metrics->_sizes._shmHist.header()._numSamples = 0;
+	const auto* sizes{metrics->_sizes._shmHist.data()};
+	const auto before100{sizes[profiler::allocSizeBucket(100)]};
+	const auto before4k{sizes[profiler::allocSizeBucket(4096)]};
+	const auto latencyBefore{metrics->_latency._shmHist.header()._numSamples};
+
+	// the operators are called directly, the compiler may drop a new expression whose memory is unused
+	constexpr size_t numAllocations{100};
+	for (size_t i = 0; i < numAllocations; ++i)
+	{
+		::operator delete[](::operator new[](100));
+		::operator delete[](::operator new[](4096, std::nothrow));
+	}
+
+	struct alignas(128) aligned
+	{
+		char _data[200];
+	};
+	for (size_t i = 0; i < numAllocations; ++i)
+	{
+		auto* ptr{::operator new(sizeof(aligned), std::align_val_t{alignof(aligned)})};
+		const auto misaligned{reinterpret_cast<uintptr_t>(ptr) % 128 != 0};
+		::operator delete(ptr, std::align_val_t{alignof(aligned)});
+		if (misaligned)
+		{
+			std::cerr << "aligned new is not aligned" << std::endl;
+			return 1;
+		}
+	}
+
+	const auto& header{metrics->_sizes._shmHist.header()};
+	std::cout << header << std::endl << metrics->_latency._shmHist.header() << std::endl;
+	if (header._numSamples < 3 * numAllocations)
+	{
+		std::cerr << "unexpected number of allocations" << std::endl;
+		return 1;
+	}
+	if (sizes[profiler::allocSizeBucket(100)] - before100 != numAllocations ||
+		sizes[profiler::allocSizeBucket(4096)] - before4k != numAllocations)
+	{
+		std::cerr << "unexpected size buckets" << std::endl;
+		return 1;
+	}
+	if (metrics->_latency._shmHist.header()._numSamples - latencyBefore < 3 * numAllocations)
+	{
+		std::cerr << "unexpected number of latency samples" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// threads get their own histograms, allocating while the thread exits must not touch them
+int testThreads()
+{
+	std::atomic<bool> failed{false};
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < 4; ++i)
+	{
+		threads.emplace_back([&failed](){
+			thread_local std::vector<int> freedAtExit(1000);
+			std::vector<std::string> strings(100, std::string(64, 'x'));
+			const auto* metrics{profiler::threadAllocMetrics()};
+			if (metrics == nullptr || metrics->_sizes._shmHist.header()._numSamples < 100)
+				failed = true;
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+	if (failed)
+	{
+		std::cerr << "thread allocations are not recorded" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testSizes() != 0)
+		return 1;
+	if (testThreads() != 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include "profilerApi.h"
+
+#include <iostream>
+
+// what histCtl does to the control page
+void operatorUpdate(profiler::timeHistogram& hist, bool enable, uint64_t ratio, uint64_t perBucket)
+{
+	auto& entry{const_cast<profiler::controlEntry&>(hist._control.entry())};
+	entry._samplingRatio = ratio;
+	entry._samplesPerBucket = perBucket;
+	entry.update(enable);
+}
+
+void run(profiler::timeHistogram& hist, size_t cnt)
+{
+	for (size_t i = 0; i < cnt; ++i)
+	{
+		hist.begin();
+		hist.end();
+	}
+}
+
+int testControl()
+{
+	ThreadLocalTimeHist(controlled, 1000, 100, "runtime control");
+	const auto& header{controlled._shmHist.header()};
+
+	if (&controlled._control.entry() == &profiler::controlPage::alwaysOn())
+	{
+		std::cerr << "call site has no control entry" << std::endl;
+		return 1;
+	}
+
+	run(controlled, 10);
+	if (header._numSamples != 10)
+	{
+		std::cerr << "unexpected enabled: " << header << std::endl;
+		return 1;
+	}
+
+	operatorUpdate(controlled, false, 0, 0);
+	run(controlled, 10);
+	controlled.sample(5);
+	if (header._numSamples != 10 || header._numCalls != 10)
+	{
+		std::cerr << "recorded while disabled: " << header << std::endl;
+		return 1;
+	}
+
+	operatorUpdate(controlled, true, 5, 0);
+	run(controlled, 100);
+	if (header._numSamples != 30 || header._samplingRatio != 5)
+	{
+		std::cerr << "unexpected ratio: " << header << std::endl;
+		return 1;
+	}
+
+	// a new resolution starts over
+	operatorUpdate(controlled, true, 0, 1);
+	run(controlled, 10);
+	if (header._numSamples != 10 || header._samplingRatio != 1 || header._samplesPerBucket != 1)
+	{
+		std::cerr << "unexpected resolution: " << header << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testControl() != 0)
+		return 1;
+
+	std::cout << "control ok" << std::endl;
+	return 0;
+}
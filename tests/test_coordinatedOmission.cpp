@@ -0,0 +1,68 @@
+#include "profilerApi.h"
+
+#include <random>
+#include <vector>
+#include <iostream>
+
+// HdrHistogram's recordValueWithExpectedInterval, one sample at a time
+void naiveCorrected(std::vector<uint64_t>& buckets, uint64_t perBucket, uint64_t interval, uint64_t sample)
+{
+	auto add = [&](uint64_t value){
+		const auto bucket{std::min<uint64_t>(value / perBucket, buckets.size() - 1)};
+		++buckets[bucket];
+	};
+	add(sample);
+	for (auto missing = sample - interval; sample >= interval && missing >= interval; missing -= interval)
+		add(missing);
+}
+
+int testBackFill(uint64_t perBucket, uint64_t numBuckets, uint64_t interval)
+{
+	profiler::timeHistogram hist{perBucket, numBuckets, "testCoordinatedOmission", 1, "coordinated omission", 0, interval};
+
+	std::mt19937 gen{ 42 };
+	std::exponential_distribution<double> dist{ 1.0 / (interval * 2) };
+
+	std::vector<uint64_t> expected(numBuckets, 0);
+	for (size_t i = 0; i < 10'000; i++)
+	{
+		const auto sample{static_cast<uint64_t>(dist(gen))};
+		hist.sample(sample);
+		naiveCorrected(expected, perBucket, interval, sample);
+	}
+
+	const auto& header{hist._shmHist.header()};
+	const auto* raw{hist._shmHist.data()};
+	const auto* corrected{raw + numBuckets};
+
+	uint64_t total{0}, rawTotal{0};
+	for (size_t i = 0; i < numBuckets; ++i)
+	{
+		if (corrected[i] != expected[i])
+		{
+			std::cerr << "bucket " << i << " corrected: " << corrected[i] << ", expected: " << expected[i] << std::endl;
+			return 1;
+		}
+		total += corrected[i];
+		rawTotal += raw[i];
+	}
+	if (total != header._correctedNumSamples || rawTotal != header._numSamples || total <= rawTotal)
+	{
+		std::cerr << "unexpected totals: " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testBackFill(1000, 100, 10'000) != 0) // interval spans several buckets
+		return 1;
+	if (testBackFill(1000, 100, 300) != 0) // several missing samples per bucket
+		return 1;
+	if (testBackFill(1, 50, 7) != 0) // mostly overflows
+		return 1;
+
+	std::cout << "coordinated omission ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include "profilerApi.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// resumes the handles it gets on its own thread, after the requested delay
+class executor final
+{
+public:
+	executor()
+	: _thread{[this](){ run(); }}
+	{}
+	~executor()
+	{
+		{
+			std::lock_guard<std::mutex> l{_mtx};
+			_stop = true;
+		}
+		_cv.notify_all();
+		_thread.join();
+	}
+
+	void post(std::coroutine_handle<> handle, std::chrono::milliseconds delay)
+	{
+		{
+			std::lock_guard<std::mutex> l{_mtx};
+			_queue.push_back({handle, std::chrono::steady_clock::now() + delay});
+		}
+		_cv.notify_all();
+	}
+
+	std::thread::id id() const { return _thread.get_id(); }
+
+private:
+	struct item
+	{
+		std::coroutine_handle<> _handle;
+		std::chrono::steady_clock::time_point _when;
+	};
+
+	void run()
+	{
+		std::unique_lock<std::mutex> l{_mtx};
+		while (!_stop || !_queue.empty())
+		{
+			if (_queue.empty())
+			{
+				_cv.wait(l);
+				continue;
+			}
+			const auto next{_queue.front()};
+			_queue.pop_front();
+			l.unlock();
+			std::this_thread::sleep_until(next._when);
+			next._handle.resume();
+			l.lock();
+		}
+	}
+
+	std::mutex _mtx;
+	std::condition_variable _cv;
+	std::deque<item> _queue;
+	bool _stop{false};
+	std::thread _thread;
+};
+
+struct resumeOn
+{
+	bool await_ready() const { return false; }
+	void await_suspend(std::coroutine_handle<> handle) { _executor.post(handle, _delay); }
+	std::thread::id await_resume() const { return std::this_thread::get_id(); }
+
+	executor& _executor;
+	std::chrono::milliseconds _delay;
+};
+
+// starts eagerly and destroys itself at the end
+struct task
+{
+	struct promise_type
+	{
+		task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+// burns cpu time of the thread, being preempted doesn't count
+void spin(std::chrono::milliseconds duration)
+{
+	const auto until{profiler::cpuTimeHistogram::threadCpuNanos() + std::chrono::nanoseconds{duration}.count()};
+	while (profiler::cpuTimeHistogram::threadCpuNanos() < static_cast<uint64_t>(until))
+		;
+}
+
+std::atomic<size_t> done{0};
+std::atomic<size_t> movedThreads{0};
+
+task work(executor& exec)
+{
+	CoroSpan(span, coroWork, 100'000, 1000, "coroutine span test");
+	spin(std::chrono::milliseconds{2});
+	const auto resumedOn{co_await CoroSpanAwait(span, (resumeOn{exec, std::chrono::milliseconds{10}}))};
+	if (resumedOn == exec.id())
+		++movedThreads;
+	spin(std::chrono::milliseconds{2});
+	++done;
+}
+
+int testCoroutines()
+{
+	constexpr size_t numCoroutines{10};
+	{
+		executor exec;
+		// suspended together, they interleave on the executor thread
+		for (size_t i = 0; i < numCoroutines; ++i)
+			work(exec);
+		while (done.load() != numCoroutines)
+			std::this_thread::yield();
+	}
+	if (movedThreads.load() != numCoroutines)
+	{
+		std::cerr << "coroutines didn't resume on the executor" << std::endl;
+		return 1;
+	}
+
+	// all the spans ended on the executor thread, the only one that created the histogram
+	profiler::shmFile<profiler::shmCpuTimeHistHeader, uint64_t> file{"shmFile_coroWork_1.shm"};
+	const auto& header{file.header()};
+	std::cout << header << std::endl;
+	if (header._wall._numSamples != numCoroutines)
+	{
+		std::cerr << "unexpected number of spans" << std::endl;
+		return 1;
+	}
+	// 10 millis suspended, then waiting for the other coroutines on the same executor
+	if (header._wall._minSample < 14'000'000)
+	{
+		std::cerr << "unexpected span latency" << std::endl;
+		return 1;
+	}
+	// 4 millis of spinning on 2 threads, the suspension is not counted
+	if (header._cpu._minSample < 4'000'000 || header._cpu._maxSample > header._wall._minSample)
+	{
+		std::cerr << "unexpected span cpu time" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testCoroutines();
+}
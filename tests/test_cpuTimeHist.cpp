@@ -0,0 +1,66 @@
+#include "profilerApi.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+int testBusyAndSleeping()
+{
+	constexpr size_t numRegions{50};
+
+	ThreadLocalCpuTimeHist(busy, 10'000, 1000, "busy region");
+	ThreadLocalCpuTimeHist(sleeping, 10'000, 1000, "sleeping region");
+	busy.resetSamples();
+	sleeping.resetSamples();
+
+	for (size_t i = 0; i < numRegions; ++i)
+	{
+		// 2 millis of the thread's own cpu time, however long it waits for a core on a loaded machine
+		CpuTimeHistBegin(busy);
+		const auto until{profiler::cpuTimeHistogram::threadCpuNanos() + 2'000'000};
+		while (profiler::cpuTimeHistogram::threadCpuNanos() < until)
+			;
+		CpuTimeHistEnd(busy);
+
+		CpuTimeHistBegin(sleeping);
+		std::this_thread::sleep_for(std::chrono::milliseconds{2});
+		CpuTimeHistEnd(sleeping);
+	}
+
+	const auto& busyHeader{busy._shmHist.header()};
+	const auto& sleepingHeader{sleeping._shmHist.header()};
+	std::cout << busyHeader << std::endl << sleepingHeader << std::endl;
+
+	for (const auto* header : {&busyHeader, &sleepingHeader})
+	{
+		if (header->_wall._numSamples != numRegions || header->_cpu._numSamples != numRegions || header->_offCpu._numSamples != numRegions)
+		{
+			std::cerr << "unexpected number of samples" << std::endl;
+			return 1;
+		}
+	}
+
+	// the busy regions spin on cpu, the sleeping ones sleep at least for their wall time.
+	// waiting for a core adds to the wall and off cpu times only
+	if (busyHeader._cpu._minSample < 2'000'000 || busyHeader._wall._minSample < 1'900'000)
+	{
+		std::cerr << "busy region is not on cpu" << std::endl;
+		return 1;
+	}
+	if (sleepingHeader._wall._minSample < 2'000'000)
+	{
+		std::cerr << "unexpected wall time" << std::endl;
+		return 1;
+	}
+	if (sleepingHeader._offCpu._sum * 2 < sleepingHeader._wall._sum)
+	{
+		std::cerr << "sleeping region is not off cpu" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testBusyAndSleeping();
+}
@@ -0,0 +1,119 @@
+#include "profilerApi.h"
+
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+constexpr size_t numRounds{10};
+
+struct regions
+{
+	uint64_t _tid{0};
+	uint64_t _fast{0};
+	uint64_t _slow{0};
+};
+
+regions work()
+{
+	ThreadLocalTimeHist(ringFast, 1000, 100, "fast regions");
+	ThreadLocalTimeHist(ringSlow, 1000, 100, "slow regions");
+	for (size_t i = 0; i < numRounds; ++i)
+	{
+		TimeHistBegin(ringFast);
+		TimeHistEnd(ringFast);
+		TimeHistBegin(ringSlow);
+		std::this_thread::sleep_for(std::chrono::microseconds{100});
+		TimeHistEnd(ringSlow);
+	}
+	return {profiler::threadId(), var(ringFast)._slot, var(ringSlow)._slot};
+}
+
+regions runThread()
+{
+	regions ids;
+	std::thread thread{[&ids]() { ids = work(); }};
+	thread.join();
+	return ids;
+}
+
+}
+
+int testOff()
+{
+	const auto ids{runThread()};
+	if (std::filesystem::exists(profiler::eventRing::fileName(::getpid(), ids._tid)))
+	{
+		std::cerr << "a ring without configuring one" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testOrder()
+{
+	EventRingConfigure(6); // 7 rounded up to 8
+	const auto ids{runThread()};
+
+	const auto file{profiler::eventRing::fileName(::getpid(), ids._tid)};
+	const profiler::shmFile<profiler::shmEventRingHeader, profiler::eventRecord> ring{file};
+	std::cout << ring.header() << std::endl;
+	if (ring.header()._numRecords != 8 || ring.header()._head != 2 * numRounds)
+	{
+		std::cerr << "unexpected ring" << std::endl;
+		return 1;
+	}
+
+	// the last 7 regions, fast then slow, one after the other
+	const auto records{profiler::snapshot(ring)};
+	if (records.size() != 7)
+	{
+		std::cerr << "unexpected number of records " << records.size() << std::endl;
+		return 1;
+	}
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const auto& record{records[i]};
+		const auto slow{(2 * numRounds - records.size() + i) % 2 == 1};
+		if (record._region != (slow ? ids._slow : ids._fast))
+		{
+			std::cerr << "record " << i << " of region " << record._region << " out of order" << std::endl;
+			return 1;
+		}
+		if (slow && record._durationNanos < 100'000)
+		{
+			std::cerr << "slow region of " << record._durationNanos << " nanos" << std::endl;
+			return 1;
+		}
+		if (i > 0 && records[i - 1]._beginNanos + records[i - 1]._durationNanos > record._beginNanos)
+		{
+			std::cerr << "record " << i << " began before the previous one ended" << std::endl;
+			return 1;
+		}
+	}
+
+	std::stringstream json;
+	size_t numEvents{0};
+	{
+		profiler::chromeTrace trace{json};
+		numEvents = trace.add(file);
+	}
+	const auto text{json.str()};
+	std::cout << text;
+	if (numEvents != 7 || text.find("\"name\":\"ringFast\"") == std::string::npos || text.find("\"name\":\"ringSlow\"") == std::string::npos
+		|| text.find("\"ph\":\"X\"") == std::string::npos || text.rfind("\"displayTimeUnit\":\"ns\"}") == std::string::npos)
+	{
+		std::cerr << "unexpected trace" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testOff() + testOrder();
+}
@@ -0,0 +1,76 @@
+#include "profilerApi.h"
+
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+
+int testTopK()
+{
+	profiler::histogram hist{100, "testExemplars", 1, "$", "top K exemplars", 8};
+
+	std::mt19937 gen{ 42 };
+	std::uniform_int_distribution<uint64_t> dist{ 0, 1'000'000 };
+
+	std::vector<uint64_t> all;
+	for (uint64_t i = 0; i < 100'000; i++)
+	{
+		const auto value{dist(gen)};
+		all.push_back(value);
+		hist.sample(value, i);
+	}
+
+	std::sort(all.begin(), all.end(), std::greater<uint64_t>{});
+
+	const auto& exemplars{hist._shmHist.header()._exemplars};
+	std::vector<uint64_t> kept;
+	for (size_t i = 0; i < exemplars._size; ++i)
+		kept.push_back(exemplars._entries[i]._value);
+	std::sort(kept.begin(), kept.end(), std::greater<uint64_t>{});
+
+	if (kept.size() != 8 || !std::equal(kept.begin(), kept.end(), all.begin()))
+	{
+		std::cerr << "unexpected exemplars: " << hist._shmHist.header() << std::endl;
+		return 1;
+	}
+	if (exemplars._threshold != kept.back())
+	{
+		std::cerr << "unexpected threshold: " << exemplars._threshold << std::endl;
+		return 1;
+	}
+	for (size_t i = 0; i < exemplars._size; ++i)
+	{
+		if (exemplars._entries[i]._threadId != profiler::threadId() || exemplars._entries[i]._timestampNanos == 0)
+		{
+			std::cerr << "missing context on exemplar " << i << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int testDisabled()
+{
+	ThreadLocalTimeHist(noExemplars, 1000, 10, "exemplars are off by default");
+	TimeHistBegin(noExemplars);
+	TimeHistEnd(noExemplars);
+
+	if (noExemplars._shmHist.header()._exemplars._size != 0)
+	{
+		std::cerr << "exemplars kept while disabled" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testTopK() != 0)
+		return 1;
+	if (testDisabled() != 0)
+		return 1;
+
+	std::cout << "exemplars ok" << std::endl;
+	return 0;
+}
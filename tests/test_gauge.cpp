@@ -0,0 +1,153 @@
+#include "profilerApi.h"
+
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint64_t second{1'000'000'000};
+constexpr size_t numThreads{4};
+constexpr size_t addsPerThread{1000};
+
+void worker()
+{
+	ThreadLocalCounter(counterRequests, "requests");
+	for (size_t i = 0; i < addsPerThread; ++i)
+		CounterAdd(counterRequests, 1);
+}
+
+}
+
+int testTimeWeighted()
+{
+	profiler::gauge depth{true, "gaugeWeighted", 1, "time weighted depth"};
+	const auto& header{depth._shmGauge.header()};
+	const uint64_t t0{1000 * second};
+
+	// 10 for a second, 20 for 2 seconds, then 0
+	depth.record(10, t0);
+	depth.record(20, t0 + second);
+	depth.record(0, t0 + 3 * second);
+	std::cout << header << std::endl;
+	if (header._last != 0 || header._min != 0 || header._max != 20 || header._numUpdates != 3)
+	{
+		std::cerr << "unexpected last, min or max" << std::endl;
+		return 1;
+	}
+	// 0 for the 4th second
+	if (std::abs(header.timeWeightedMean(t0 + 4 * second) - 12.5) > 1e-9)
+	{
+		std::cerr << "unexpected time weighted mean " << header.timeWeightedMean(t0 + 4 * second) << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testMacro()
+{
+	ThreadLocalGauge(gaugeDepth, false, "queue depth");
+	for (int64_t i = 0; i < 5; ++i)
+		GaugeAdd(gaugeDepth, 1);
+	GaugeAdd(gaugeDepth, -7);
+	GaugeSet(gaugeDepth, 3);
+
+	const auto& header{gaugeDepth._shmGauge.header()};
+	if (header._last != 3 || header._min != -2 || header._max != 5 || header._numUpdates != 7 || header._weightedSum != 0)
+	{
+		std::cerr << "unexpected gauge " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// a depth kept by +1 and -1 across a disable from the control page
+int testDisabledAdd()
+{
+	ThreadLocalGauge(gaugeDisabled, false, "queue depth, disabled for a while");
+	auto& entry{const_cast<profiler::controlEntry&>(gaugeDisabled._control.entry())};
+	GaugeAdd(gaugeDisabled, 1);
+	entry.update(false);
+	GaugeAdd(gaugeDisabled, 1);
+	GaugeAdd(gaugeDisabled, 1);
+	entry.update(true);
+	GaugeAdd(gaugeDisabled, -1);
+	GaugeAdd(gaugeDisabled, -1);
+
+	const auto& header{gaugeDisabled._shmGauge.header()};
+	if (header._last != 1 || header._numUpdates != 3 || header._min != 1 || header._max != 2)
+	{
+		std::cerr << "the gauge drifted while disabled " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// a producer thread adds and a consumer thread subtracts, the same file
+int testProcessGauge()
+{
+	ProcessGauge(gaugePending, true, "produced, not consumed yet");
+	auto producer = [](){
+		for (size_t i = 0; i < addsPerThread; ++i)
+			GaugeAdd(gaugePending, 1);
+	};
+	auto consumer = [](){
+		for (size_t i = 0; i < addsPerThread; ++i)
+			GaugeAdd(gaugePending, -1);
+	};
+	std::thread produce{producer};
+	std::thread consume{consumer};
+	produce.join();
+	consume.join();
+
+	const auto& header{gaugePending._shmGauge.header()};
+	std::cout << header << std::endl;
+	if (header._last != 0 || header._numUpdates != 2 * addsPerThread || header._min > 0 || header._max < 0)
+	{
+		std::cerr << "unexpected process gauge " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testCounter()
+{
+	for (const auto& entry : std::filesystem::directory_iterator{"."})
+	{
+		if (entry.path().filename().string().rfind("shmFile_counterRequests_", 0) == 0)
+			std::filesystem::remove(entry.path());
+	}
+
+	// a process that counted here before, its shard has the same thread number and another pid
+	constexpr uint64_t previousCount{5};
+	{
+		profiler::shmFile<profiler::shmCounterHeader, uint64_t> previous{
+			profiler::counter::fileName("counterRequests", static_cast<uint64_t>(::getpid()) + 1, 1), profiler::shmCounterHeader{"requests"}, 0};
+		previous.header()._value = previousCount;
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; ++t)
+		threads.emplace_back(worker);
+	for (auto& thread : threads)
+		thread.join();
+
+	// the threads are gone, their shards are not
+	const auto total{profiler::counterTotal(".", "counterRequests")};
+	if (total != numThreads * addsPerThread + previousCount)
+	{
+		std::cerr << "unexpected total of the shards " << total << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testTimeWeighted() + testMacro() + testDisabledAdd() + testProcessGauge() + testCounter();
+}
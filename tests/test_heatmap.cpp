@@ -0,0 +1,115 @@
+#include "profilerApi.h"
+
+#include <iostream>
+#include <thread>
+
+namespace
+{
+
+uint64_t rowSum(const profiler::timeHeatmap& heatmap, uint64_t index)
+{
+	const auto& header{heatmap._shmHeatmap.header()};
+	const auto* row{heatmap._shmHeatmap.data() + index * header.rowSize()};
+	uint64_t sum{0};
+	for (uint64_t i = 1; i < header.rowSize(); ++i)
+		sum += row[i];
+	return sum;
+}
+
+uint64_t rowEnd(const profiler::timeHeatmap& heatmap, uint64_t index)
+{
+	return profiler::shmHeatmapHeader::rowEnd(heatmap._shmHeatmap.data() + index * heatmap._shmHeatmap.header().rowSize());
+}
+
+}
+
+int testRotation()
+{
+	constexpr uint64_t second{1'000'000'000};
+	// 4 rows of a second, 10 latency buckets of a milli
+	profiler::timeHeatmap heatmap{second, 4, 1'000'000, 10, "heatmapRotation", 1, "rotation"};
+
+	const uint64_t t0{1000 * second};
+	for (uint64_t i = 0; i < 5; ++i)
+		heatmap.record(i * 1'000'000, t0); // row 0, buckets 0 - 4
+	heatmap.record(100'000'000, t0 + second); // row 1, overflow
+	heatmap.record(1'500'000, t0 + second + 1);
+
+	const auto& header{heatmap._shmHeatmap.header()};
+	if (rowSum(heatmap, 0) != 5 || rowSum(heatmap, 1) != 2 || header._currentIndex != 1 || header._overfows != 1)
+	{
+		std::cerr << "unexpected rows " << header << std::endl;
+		return 1;
+	}
+	const auto* row1{heatmap._shmHeatmap.data() + header.rowSize()};
+	if (row1[1 + 1] != 1 || row1[10] != 1 || rowEnd(heatmap, 1) != t0 + 2 * second)
+	{
+		std::cerr << "unexpected latency buckets of row 1" << std::endl;
+		return 1;
+	}
+
+	// 4 seconds later the ring is back at row 1, it's cleared lazily and row 0 keeps its stale interval
+	heatmap.record(3'000'000, t0 + 5 * second);
+	if (rowSum(heatmap, 1) != 1 || header._currentIndex != 1 || rowEnd(heatmap, 1) != t0 + 6 * second)
+	{
+		std::cerr << "row 1 was not cleared on rotation" << std::endl;
+		return 1;
+	}
+	if (rowSum(heatmap, 0) != 5 || rowEnd(heatmap, 0) != t0 + second)
+	{
+		std::cerr << "row 0 was touched" << std::endl;
+		return 1;
+	}
+	// readers drop rows older than the ring
+	const auto currentEnd{rowEnd(heatmap, header._currentIndex)};
+	if (currentEnd - rowEnd(heatmap, 0) < header._numBuckets * header._nanosPerBucket)
+	{
+		std::cerr << "row 0 doesn't look stale" << std::endl;
+		return 1;
+	}
+	if (header._numSamples != 8)
+	{
+		std::cerr << "unexpected number of samples" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testTimedRegions()
+{
+	ThreadLocalTimeHeatmap(heatmapRegions, 100'000'000, 50, 100'000, 100, "timed regions");
+	for (size_t i = 0; i < 20; ++i)
+	{
+		TimeHistBegin(heatmapRegions);
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+		TimeHistEnd(heatmapRegions);
+	}
+
+	const auto& header{heatmapRegions._shmHeatmap.header()};
+	std::cout << header << std::endl;
+	uint64_t total{0};
+	for (uint64_t index = 0; index < header._numBuckets; ++index)
+	{
+		const auto* row{heatmapRegions._shmHeatmap.data() + index * header.rowSize()};
+		for (uint64_t bucket = 0; bucket < 10; ++bucket)
+		{
+			if (row[1 + bucket] != 0)
+			{
+				std::cerr << "a 1 milli region below 1 milli" << std::endl;
+				return 1;
+			}
+		}
+		total += rowSum(heatmapRegions, index);
+	}
+	if (total != 20 || header._numSamples != 20)
+	{
+		std::cerr << "unexpected number of samples " << total << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testRotation() + testTimedRegions();
+}
@@ -0,0 +1,134 @@
+#include "profilerApi.h"
+
+#include <iostream>
+#include <thread>
+
+int testAxes()
+{
+	const auto linear{profiler::linearAxis(10, 5, "linear")};
+	// 4 buckets per power of 2, up to 2^(2 + 3) units
+	const auto logLinear{profiler::logLinearAxis(1, 2, 3, "log linear")};
+
+	int rc{0};
+	auto check = [&rc](const profiler::shmAxis& axis, uint64_t value, uint64_t bucket){
+		const auto index{axis.index(value)};
+		if (index != bucket)
+		{
+			std::cerr << axis._description << ": value " << value << " is in bucket " << index << " instead of " << bucket << std::endl;
+			rc = 1;
+		}
+		// the lower bound of the bucket maps back to it
+		if (bucket + 1 < axis._numBuckets && axis.index(axis.lowerBound(bucket)) != bucket)
+		{
+			std::cerr << axis._description << ": lower bound of bucket " << bucket << " is off" << std::endl;
+			rc = 1;
+		}
+	};
+	check(linear, 0, 0);
+	check(linear, 19, 1);
+	check(linear, 40, 4);
+	check(linear, 1000, 4);
+
+	if (logLinear._numBuckets != 17)
+	{
+		std::cerr << "unexpected number of log linear buckets " << logLinear._numBuckets << std::endl;
+		rc = 1;
+	}
+	check(logLinear, 3, 3);
+	check(logLinear, 4, 4);
+	check(logLinear, 7, 7);
+	check(logLinear, 8, 8);
+	check(logLinear, 9, 8); // 8-9 share a bucket
+	check(logLinear, 10, 9);
+	check(logLinear, 31, 15);
+	check(logLinear, 32, 16);
+	check(logLinear, 1'000'000, 16);
+	for (uint64_t bucket = 0; bucket < logLinear._numBuckets - 1; ++bucket)
+		check(logLinear, logLinear.lowerBound(bucket), bucket);
+	return rc;
+}
+
+int testSamples()
+{
+	// payload sizes from 1 byte to 1MB, latency in micros up to 10 millis
+	ThreadLocalHist2D(sizeLatency,
+					  profiler::logLinearAxis(1, 2, 20, "bytes"),
+					  profiler::linearAxis(1000, 10'000, "latency micros"),
+					  "latency by payload size");
+	sizeLatency.resetSamples();
+
+	// latency grows with the size
+	uint64_t numSamples{0};
+	for (uint64_t size = 1; size <= (1 << 20); size *= 2)
+	{
+		for (uint64_t i = 0; i < 100; ++i)
+		{
+			SampleHist2D(sizeLatency, size, size * 5 + i * 1000);
+			++numSamples;
+		}
+	}
+	SampleHist2D(sizeLatency, uint64_t{1} << 40, 1);
+	++numSamples;
+
+	Hist2DBegin(sizeLatency);
+	std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	Hist2DEnd(sizeLatency, 100);
+	++numSamples;
+
+	const auto& header{sizeLatency._shmHist.header()};
+	std::cout << header << std::endl;
+	if (header._numSamples != numSamples)
+	{
+		std::cerr << "unexpected number of samples" << std::endl;
+		return 1;
+	}
+	if (header._x._overfows != 1)
+	{
+		std::cerr << "unexpected number of x overflows" << std::endl;
+		return 1;
+	}
+
+	// the row of 1KB holds its 100 samples, 5 to 104 micros
+	const auto row{header._x.index(1024)};
+	uint64_t rowSamples{0};
+	for (uint64_t column = 0; column < header._y._numBuckets; ++column)
+	{
+		const auto count{sizeLatency.count(row, column)};
+		rowSamples += count;
+		if (count > 0 && (column < 5 || column > 104))
+		{
+			std::cerr << "unexpected latency bucket " << column << " in the 1KB row" << std::endl;
+			return 1;
+		}
+	}
+	if (rowSamples != 100)
+	{
+		std::cerr << "unexpected number of samples in the 1KB row " << rowSamples << std::endl;
+		return 1;
+	}
+
+	// the sleep is in the row of 100 bytes
+	const auto sleepRow{header._x.index(100)};
+	uint64_t sleepSamples{0};
+	for (uint64_t column = 1000; column < header._y._numBuckets; ++column)
+		sleepSamples += sizeLatency.count(sleepRow, column);
+	if (sleepSamples != 1)
+	{
+		std::cerr << "the timed region is not in its row" << std::endl;
+		return 1;
+	}
+
+	// a reader sees the same matrix
+	profiler::shmFile<profiler::shmHist2DHeader, uint64_t> reader{"shmFile_sizeLatency_1.shm"};
+	if (reader.header()._numSamples != numSamples || reader.header()._y._numBuckets != 10'000)
+	{
+		std::cerr << "reader doesn't see the samples" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testAxes() + testSamples();
+}
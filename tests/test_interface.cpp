@@ -49,7 +49,7 @@ int testThreadComm()
 	struct Node
 	{
 		int _id;
-		std::chrono::time_point<std::chrono::system_clock> _sentTP;
+		profiler::latencyToken _sent;
 	};
 	std::queue<Node> queue;
 	std::mutex mtx;
@@ -63,7 +63,7 @@ int testThreadComm()
 		{
 			{
 				std::unique_lock<std::mutex> l{mtx};
-				queue.push(Node{cnt++, std::chrono::system_clock::now()});
+				queue.push(Node{cnt++, LatencyStamp()});
 			}
 			cv.notify_all();
 			std::this_thread::sleep_for(std::chrono::microseconds{1});
@@ -73,7 +73,7 @@ int testThreadComm()
 	}};
 
 	auto consumer{[&queue, &mtx, &cv, &end](){
-		ThreadLocalTimeHist(threadComm, 1000, 300, "passing messages between threads");	
+		ThreadLocalLatencyHist(threadComm, 1000, 300, "passing messages between threads");	
 		
 		int cnt{0};
 		while(!end.load(std::memory_order_acquire))
@@ -84,7 +84,7 @@ int testThreadComm()
 			if (!queue.empty())
 			{
 				auto& node{queue.front()};
-				TimeHistSample(threadComm, node._sentTP, std::chrono::system_clock::now());
+				LatencyHistConsume(threadComm, node._sent);
 				queue.pop();
 				cnt++;
 			}
@@ -102,7 +102,7 @@ int testThreadComm()
 	end.store(true, std::memory_order_release);
 	{
 		std::unique_lock<std::mutex> l{mtx};
-		queue.push(Node{0, std::chrono::system_clock::now()}); // release the consumer
+		queue.push(Node{0, LatencyStamp()}); // release the consumer
 	}
 	cv.notify_all();
 
@@ -0,0 +1,97 @@
+#include "profilerApi.h"
+
+#include <atomic>
+#include <thread>
+#include <iostream>
+
+// single slot mailbox, enough to pass tokens between 2 threads
+struct mailbox
+{
+	std::atomic<bool> _full{false};
+	profiler::latencyToken _token;
+};
+
+int testThreads(bool shared)
+{
+	constexpr size_t numMessages{10'000};
+	mailbox box;
+
+	std::thread producer{[&box, shared](){
+		for (size_t i = 0; i < numMessages; ++i)
+		{
+			while (box._full.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			box._token = shared ? LatencyStampShared() : LatencyStamp();
+			box._full.store(true, std::memory_order_release);
+		}
+	}};
+
+	ThreadLocalLatencyHist(latencyTokens, 100, 1000, "latency tokens between threads");
+	latencyTokens.resetSamples();
+	for (size_t i = 0; i < numMessages; ++i)
+	{
+		while (!box._full.load(std::memory_order_acquire))
+			std::this_thread::yield();
+		if (box._token.isShared() != shared)
+		{
+			std::cerr << "unexpected token source" << std::endl;
+			producer.join();
+			return 1;
+		}
+		LatencyHistConsume(latencyTokens, box._token);
+		box._full.store(false, std::memory_order_release);
+	}
+	producer.join();
+
+	const auto& header{latencyTokens._shmHist.header()};
+	std::cout << header << std::endl;
+	if (header._numSamples != numMessages)
+	{
+		std::cerr << "unexpected number of samples" << std::endl;
+		return 1;
+	}
+	// 1 second is far beyond any hand over between 2 threads
+	if (header._maxSample > 1'000'000'000)
+	{
+		std::cerr << "unexpected max latency, is the tsc calibrated?" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testElapsed()
+{
+	const auto tsc{profiler::latencyToken::now()};
+	const auto shared{profiler::latencyToken::shared()};
+	std::this_thread::sleep_for(std::chrono::milliseconds{20});
+	if (tsc.isShared() == profiler::tscCalibration::invariantTsc())
+	{
+		std::cerr << "the stamp must be a TSC one only when the TSC is invariant" << std::endl;
+		return 1;
+	}
+
+	for (const auto& token : {tsc, shared})
+	{
+		const auto nanos{token.elapsedNanos()};
+		if (nanos < 15'000'000 || nanos > 1'000'000'000)
+		{
+			std::cerr << "unexpected elapsed: " << nanos << ", shared: " << token.isShared() << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testElapsed() != 0)
+		return 1;
+	if (testThreads(false) != 0)
+		return 1;
+	if (testThreads(true) != 0)
+		return 1;
+
+	std::cout << "tsc invariant: " << profiler::tscCalibration::instance()._invariant
+		<< ", nanos per tick: " << profiler::tscCalibration::instance()._nanosPerTick << std::endl;
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include "profilerApi.h"
+
+#include <iostream>
+
+int testCalibration()
+{
+	ThreadLocalTimeHist(calibrated, 1, 1000, "calibration");
+	const auto& overhead{calibrated._shmHist.header()._overhead};
+	std::cout << overhead << std::endl;
+	if (overhead._rounds == 0 || overhead._min > overhead._median || overhead._median > overhead._p90 ||
+		overhead._p90 > overhead._p99 || overhead._p99 > overhead._max)
+	{
+		std::cerr << "unexpected distribution" << std::endl;
+		return 1;
+	}
+	// begin() and end() with 2 clock reads, even a syscall per read is far below
+	if (overhead._median > 10'000)
+	{
+		std::cerr << "unexpected median" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+namespace
+{
+
+// nanos of the median sample, a bucket per nano
+uint64_t median(const profiler::timeHistogram& hist)
+{
+	const auto& header{hist._shmHist.header()};
+	uint64_t count{0};
+	for (uint64_t bucket = 0; bucket < header._numBuckets; ++bucket)
+	{
+		count += hist._shmHist.data()[bucket];
+		if (2 * count >= header._numSamples)
+			return bucket;
+	}
+	return header._numBuckets;
+}
+
+}
+
+// empty regions measure the overhead only, without it they are a few nanos.
+// medians and minimums, a preempted region adds seconds to the sums
+int testSubtracted()
+{
+	constexpr size_t numRegions{10'000};
+
+	ThreadLocalTimeHist(withOverhead, 1, 1000, "empty regions");
+	ThreadLocalTimeHistOverheadFree(withoutOverhead, 1, 1000, "empty regions, overhead subtracted");
+	withOverhead.resetSamples();
+	withoutOverhead.resetSamples();
+
+	for (size_t i = 0; i < numRegions; ++i)
+	{
+		TimeHistBegin(withOverhead);
+		TimeHistEnd(withOverhead);
+		TimeHistBegin(withoutOverhead);
+		TimeHistEnd(withoutOverhead);
+	}
+
+	const auto& raw{withOverhead._shmHist.header()};
+	const auto& subtracted{withoutOverhead._shmHist.header()};
+	std::cout << raw << std::endl << subtracted << std::endl;
+
+	if (raw._overhead._subtracted != 0 || subtracted._overhead._subtracted == 0 || raw._overhead._median == 0)
+	{
+		std::cerr << "unexpected overhead in the header" << std::endl;
+		return 1;
+	}
+	const auto rawMedian{median(withOverhead)};
+	const auto subtractedMedian{median(withoutOverhead)};
+	if (subtractedMedian * 2 >= rawMedian || subtracted._minSample >= raw._minSample)
+	{
+		std::cerr << "overhead is not subtracted, medians: " << rawMedian << " and " << subtractedMedian << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// the caller measured the region, there is no begin() and end() in it to subtract
+int testCallerMeasured()
+{
+	ThreadLocalTimeHistOverheadFree(callerMeasured, 1, 1000, "regions measured by the caller");
+	callerMeasured.resetSamples();
+
+	const auto begin{std::chrono::system_clock::now()};
+	TimeHistSample(callerMeasured, begin, begin + std::chrono::nanoseconds{5});
+	const auto& header{callerMeasured._shmHist.header()};
+	if (header._numSamples != 1 || header._minSample != 5)
+	{
+		std::cerr << "unexpected sample of a caller measured region" << std::endl << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testCalibration() != 0)
+		return 1;
+	if (testSubtracted() != 0)
+		return 1;
+	if (testCallerMeasured() != 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include "profilerApi.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+// perf events may not be available at all (containers, perf_event_paranoid),
+// the time histogram must work regardless and the opened counters must see every region
+int testRegions()
+{
+	constexpr size_t numRegions{100};
+
+	ThreadLocalPerfHist(perfRegions, 10'000, 100, "perf events of a region",
+						{profiler::perfEvent::instructions, 1000},
+						{profiler::perfEvent::contextSwitches, 1});
+	perfRegions.resetSamples();
+
+	for (size_t i = 0; i < numRegions; ++i)
+	{
+		PerfHistBegin(perfRegions);
+		// gives up the cpu, at least 1 context switch per region
+		std::this_thread::sleep_for(std::chrono::microseconds{100});
+		PerfHistEnd(perfRegions);
+	}
+
+	const auto& header{perfRegions._shmHist.header()};
+	std::cout << header << std::endl;
+	if (header._numSamples != numRegions || header._numEvents != 2)
+	{
+		std::cerr << "unexpected number of samples" << std::endl;
+		return 1;
+	}
+	if (header._minSample < 100'000)
+	{
+		std::cerr << "unexpected region time" << std::endl;
+		return 1;
+	}
+
+	for (size_t i = 0; i < header._numEvents; ++i)
+	{
+		const auto& counter{header._counters[i]};
+		const auto opened{static_cast<profiler::perfEvent>(counter._opened)};
+		const auto expected{opened == profiler::perfEvent::none ? 0 : numRegions};
+		if (counter._numSamples != expected)
+		{
+			std::cerr << "unexpected counter samples: " << i << std::endl;
+			return 1;
+		}
+		// the task clock counts nanos, in buckets of the time histogram
+		if (opened == profiler::perfEvent::taskClock && counter._requested != counter._opened &&
+			counter._unitsPerBucket != header._samplesPerBucket)
+		{
+			std::cerr << "the fallback kept the units of the hardware event: " << i << std::endl;
+			return 1;
+		}
+	}
+
+	const auto& switches{header._counters[1]};
+	if (static_cast<profiler::perfEvent>(switches._opened) == profiler::perfEvent::contextSwitches && switches._minSample < 1)
+	{
+		std::cerr << "a sleeping region must be switched out" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// hardware events that can't be opened fall back to the task clock
+int testFallback()
+{
+	profiler::perfCounter counter;
+	const auto opened{counter.open(profiler::perfEvent::cycles, -1)};
+	std::cout << "cycles opened as: " << profiler::perfEventName(opened) << ", rdpmc: " << counter.rdpmc() << std::endl;
+	if (opened == profiler::perfEvent::none)
+		return 0;
+
+	const auto begin{counter.read()._count};
+	volatile uint64_t sum{0};
+	for (uint64_t i = 0; i < 10'000'000; ++i)
+		sum = sum + i;
+	if (counter.read()._count <= begin)
+	{
+		std::cerr << "counter didn't advance" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// a counter on the PMU for half of the region counted half of its events
+int testMultiplexed()
+{
+	bool multiplexed{false};
+	const auto scaled{profiler::regionCount({1000, 0, 0}, {2000, 400, 200}, multiplexed)};
+	const auto whole{profiler::regionCount({1000, 0, 0}, {2000, 400, 400}, multiplexed)};
+	if (scaled != 2000 || whole != 1000 || multiplexed)
+	{
+		std::cerr << "unexpected multiplexed counts: " << scaled << ", " << whole << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testRegions() != 0)
+		return 1;
+	if (testFallback() != 0)
+		return 1;
+	if (testMultiplexed() != 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "profilerApi.h"
+
+#include <memory>
+#include <string>
+#include <iostream>
+
+int add(int l, int r) { return l + r; }
+
+void increment(int& value) { ++value; }
+
+std::unique_ptr<std::string> wrap(std::unique_ptr<std::string> str)
+{
+	str->append(" wrapped");
+	return str;
+}
+
+int& pick(int& value) { return value; }
+
+int testProfiled()
+{
+	int value{41};
+
+	for (size_t i = 0; i < 10; ++i)
+	{
+		if (HistProfiled(profiledAdd, 1, 100, "add calls", add, 40, 2) != 42)
+		{
+			std::cerr << "unexpected return value" << std::endl;
+			return 1;
+		}
+	}
+
+	HistProfiled(profiledIncrement, 1, 100, "void calls", increment, value);
+	if (value != 42)
+	{
+		std::cerr << "argument was not passed by reference: " << value << std::endl;
+		return 1;
+	}
+
+	auto str{HistProfiled(profiledWrap, 1, 100, "move only calls", wrap, std::make_unique<std::string>("str"))};
+	if (!str || *str != "str wrapped")
+	{
+		std::cerr << "unexpected move only result" << std::endl;
+		return 1;
+	}
+
+	int& ref{HistProfiled(profiledPick, 1, 100, "reference calls", pick, value)};
+	if (&ref != &value)
+	{
+		std::cerr << "reference was not preserved" << std::endl;
+		return 1;
+	}
+
+	const auto lambdaRet{HistProfiled(profiledLambda, 1, 100, "lambda calls", [](){ return 7; })};
+	if (lambdaRet != 7)
+	{
+		std::cerr << "unexpected lambda result" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testProfiled() != 0)
+		return 1;
+
+	std::cout << "profiled ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,142 @@
+#include "profilerApi.h"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+
+constexpr uint64_t milli{1'000'000};
+
+uint64_t ringSum(const profiler::rateCounter& rate, uint64_t offset, uint64_t numBuckets)
+{
+	uint64_t sum{0};
+	for (uint64_t i = 0; i < numBuckets; ++i)
+		sum += rate._shmRate.data()[offset + i];
+	return sum;
+}
+
+}
+
+int testGaps()
+{
+	profiler::rateCounter rate{milli, 10, "rateGaps", 1, "gaps"};
+	const auto& header{rate._shmRate.header()};
+	const uint64_t t0{1'000'000 * milli};
+
+	// a full lap, one event per milli
+	for (uint64_t i = 0; i < 10; ++i)
+		rate.record(1, t0 + i * milli);
+	if (ringSum(rate, 0, 10) != 10)
+	{
+		std::cerr << "unexpected full lap" << std::endl;
+		return 1;
+	}
+
+	// 3 idle millis: their buckets held the previous lap
+	rate.record(1, t0 + 13 * milli);
+	if (ringSum(rate, 0, 10) != 7 || rate._shmRate.data()[0] != 0 || rate._shmRate.data()[3] != 1)
+	{
+		std::cerr << "skipped buckets were not cleared " << header << std::endl;
+		return 1;
+	}
+
+	// idle for more than a lap, only the new sample is left
+	rate.record(5, t0 + 40 * milli);
+	if (ringSum(rate, 0, 10) != 5 || header._currentIndex != 0 || header._lastEpoch != t0 / milli + 40)
+	{
+		std::cerr << "phantom rates after an idle period " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testResolutions()
+{
+	profiler::rateCounter rate{milli, 100, "rateResolutions", 1, "resolutions", {{10 * milli, 10}, {100 * milli, 5}}};
+	const auto& header{rate._shmRate.header()};
+	const uint64_t t0{1'000'000 * milli};
+
+	// 250 millis, 2 events per milli
+	for (uint64_t i = 0; i < 250; ++i)
+		rate.record(2, t0 + i * milli);
+
+	const auto& tens{header._coarser[0]};
+	const auto& hundreds{header._coarser[1]};
+	std::cout << header << std::endl;
+	if (header._numCoarser != 2 || tens._offset != 100 || hundreds._offset != 110)
+	{
+		std::cerr << "unexpected layout of the resolutions" << std::endl;
+		return 1;
+	}
+	// the last 100 millis, 10 buckets of 10 millis and the whole 250 millis
+	if (ringSum(rate, 0, 100) != 200 || ringSum(rate, tens._offset, 10) != 200 || ringSum(rate, hundreds._offset, 5) != 500)
+	{
+		std::cerr << "unexpected sums of the resolutions" << std::endl;
+		return 1;
+	}
+	if (rate._shmRate.data()[tens._offset + tens._currentIndex] != 20 || rate._shmRate.data()[hundreds._offset + hundreds._currentIndex] != 100)
+	{
+		std::cerr << "unexpected current buckets of the resolutions" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		profiler::rateCounter invalid{milli, 100, "rateInvalid", 1, "invalid", {{1'500'000, 10}}};
+		std::cerr << "a resolution that is not a multiple was accepted" << std::endl;
+		return 1;
+	}
+	catch (const std::runtime_error&)
+	{
+	}
+	return 0;
+}
+
+int testEwma()
+{
+	profiler::rateCounter rate{milli, 10, "rateEwma", 1, "ewma"};
+	const auto& header{rate._shmRate.header()};
+	const uint64_t t0{1'000'000 * milli};
+
+	// 1000 events per milli, a million per second
+	uint64_t t{t0};
+	for (; t < t0 + 200 * milli; t += milli / 10)
+		rate.record(100, t);
+	if (std::abs(header._ewmaPerSecond - 1e6) > 1e4)
+	{
+		std::cerr << "ewma didn't converge: " << header._ewmaPerSecond << std::endl;
+		return 1;
+	}
+
+	// idle for 10 laps, the rate decays without scanning the ring
+	rate.record(1, t + 100 * milli);
+	if (header._ewmaPerSecond > 1e3)
+	{
+		std::cerr << "ewma didn't decay: " << header._ewmaPerSecond << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testMacro()
+{
+	ThreadLocalRateCntResolutions(rateMacro, milli, 1000, "rate per milli, second and minute",
+								  {1'000'000'000, 60}, {60'000'000'000, 60});
+	for (size_t i = 0; i < 1000; ++i)
+		RateCntSample(rateMacro, 1);
+
+	const auto& header{rateMacro._shmRate.header()};
+	if (header._numCoarser != 2 || ringSum(rateMacro, header._coarser[1]._offset, 60) != 1000)
+	{
+		std::cerr << "unexpected counts of the macro" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testGaps() + testResolutions() + testEwma() + testMacro();
+}
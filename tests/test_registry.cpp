@@ -0,0 +1,96 @@
+#include "profilerApi.h"
+
+#include <set>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <iostream>
+#include <string.h>
+
+std::mutex mtx;
+std::set<std::string> fileNames;
+size_t numRecorded{0};
+
+void record(const std::filesystem::path& filename)
+{
+	std::lock_guard<std::mutex> l{mtx};
+	fileNames.insert(filename.string());
+	++numRecorded;
+}
+
+void siteA()
+{
+	ThreadLocalTimeHist(registryShared, 1000, 10, "registry call site A");
+	record(registryShared._shmHist._filename);
+}
+
+void siteB()
+{
+	ThreadLocalTimeHist(registryShared, 1000, 10, "registry call site B");
+	record(registryShared._shmHist._filename);
+}
+
+int testConcurrentStartup()
+{
+	std::atomic<bool> go{false};
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < 32; ++i)
+	{
+		threads.emplace_back([&go, i](){
+			while (!go.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			if (i % 2 == 0)
+				siteA();
+			else
+				siteB();
+		});
+	}
+	go.store(true, std::memory_order_release);
+	for (auto& t : threads)
+		t.join();
+
+	if (numRecorded != 32 || fileNames.size() != 32)
+	{
+		std::cerr << "file name collision, threads: " << numRecorded << ", unique files: " << fileNames.size() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testMetadata()
+{
+	const auto& registry{profiler::metricRegistry::instance()};
+	size_t sites{0};
+	for (size_t slot = 0; slot < registry.size(); ++slot)
+	{
+		const auto* site{registry.site(slot)};
+		if (strcmp(site->_id, "registryShared") == 0)
+		{
+			++sites;
+			if (site->_slot != slot || site->_kind != profiler::metricKind::timeHistogram)
+			{
+				std::cerr << "unexpected metadata for slot " << slot << std::endl;
+				return 1;
+			}
+		}
+	}
+	if (sites != 2)
+	{
+		std::cerr << "expected 2 call sites, got: " << sites << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testConcurrentStartup() != 0)
+		return 1;
+	if (testMetadata() != 0)
+		return 1;
+
+	std::cout << "registry ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "profilerApi.h"
+
+#include <chrono>
+#include <iostream>
+
+int testFixedRatio()
+{
+	ThreadLocalTimeHistSampled(sampledFixed, 1, 100, 10, "1 in 10");
+
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		TimeHistBegin(sampledFixed);
+		TimeHistEnd(sampledFixed);
+	}
+
+	const auto& header{sampledFixed._shmHist.header()};
+	if (header._numSamples != 100 || header._numCalls != 1000 || header._samplingRatio != 10)
+	{
+		std::cerr << "unexpected fixed sampling: " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testAdaptive()
+{
+	// 1 micro per second is far below the cost of measuring every call
+	ThreadLocalTimeHistAdaptive(sampledAdaptive, 1, 100, 1000, "adaptive");
+
+	const auto until{std::chrono::steady_clock::now() + std::chrono::milliseconds{1500}};
+	while (std::chrono::steady_clock::now() < until)
+	{
+		TimeHistBegin(sampledAdaptive);
+		TimeHistEnd(sampledAdaptive);
+	}
+
+	const auto& header{sampledAdaptive._shmHist.header()};
+	if (header._samplingCostNanos == 0 || header._samplingRatio <= 1 || header._numCalls <= header._numSamples)
+	{
+		std::cerr << "unexpected adaptive sampling: " << header << std::endl;
+		return 1;
+	}
+	std::cout << header << std::endl;
+
+	// histCtl disable and enable keep adaptive sampling, a ratio from the operator overrides it until it's back to 0
+	auto& entry{const_cast<profiler::controlEntry&>(sampledAdaptive._control.entry())};
+	const auto adaptedRatio{header._samplingRatio};
+	entry.update(false);
+	entry.update(true);
+	TimeHistBegin(sampledAdaptive);
+	TimeHistEnd(sampledAdaptive);
+	if (header._samplingBudgetNanos != 1000 || header._samplingRatio != adaptedRatio)
+	{
+		std::cerr << "adaptive sampling was switched off by a toggle: " << header << std::endl;
+		return 1;
+	}
+
+	entry._samplingRatio = 5;
+	entry.update(true);
+	TimeHistBegin(sampledAdaptive);
+	TimeHistEnd(sampledAdaptive);
+	if (header._samplingBudgetNanos != 0 || header._samplingRatio != 5)
+	{
+		std::cerr << "the operator's ratio didn't override adaptive sampling: " << header << std::endl;
+		return 1;
+	}
+
+	entry._samplingRatio = 0;
+	entry.update(true);
+	TimeHistBegin(sampledAdaptive);
+	TimeHistEnd(sampledAdaptive);
+	if (header._samplingBudgetNanos != 1000 || header._samplingRatio != 1)
+	{
+		std::cerr << "adaptive sampling was not restored: " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// resetSamples zeroes _numCalls, the calls counted since the last adapt() must not wrap around
+int testAdaptiveReset()
+{
+	ThreadLocalTimeHistAdaptive(adaptiveReset, 1, 100, 1000, "adaptive, reset");
+	const auto& header{adaptiveReset._shmHist.header()};
+
+	for (size_t round = 0; round < 2; ++round)
+	{
+		const auto until{std::chrono::steady_clock::now() + std::chrono::milliseconds{1100}};
+		while (std::chrono::steady_clock::now() < until)
+		{
+			TimeHistBegin(adaptiveReset);
+			TimeHistEnd(adaptiveReset);
+		}
+		if (round == 0)
+			adaptiveReset.resetSamples();
+	}
+
+	// a few million calls per second over a budget of a micro, far from 2^64
+	if (header._samplingRatio > 1'000'000'000'000)
+	{
+		std::cerr << "the calls since the reset wrapped around: " << header << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testFixedRatio() != 0)
+		return 1;
+	if (testAdaptive() != 0)
+		return 1;
+	if (testAdaptiveReset() != 0)
+		return 1;
+
+	std::cout << "sampling ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+	thread churn across many call sites: every short lived thread creates a file and a mapping
+	per call site and must give the mapping back when it exits.
+	fails when a threshold is exceeded, the defaults are small enough for ctest,
+	a production like run: test_scale --threads 4000 --sites 20 --concurrent 64
+
+	test_scale [--threads N] [--sites N] [--concurrent N] [--rate threadsPerSecond]
+			   [--maxCreateMicros N] [--maxRssGrowthMB N] [--maxMapsGrowth N] [--maxRefreshMicrosPerFile N]
+*/
+#include "profilerApi.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <string.h>
+
+namespace
+{
+
+constexpr size_t maxSites{64};
+
+struct options
+{
+	size_t _threads{100};
+	size_t _sites{20};
+	size_t _concurrent{8};
+	size_t _rate{0}; // threads per second, 0 - as fast as possible
+	uint64_t _maxCreateMicros{20'000}; // p99 cpu time of the first sample of a thread at a call site
+	uint64_t _maxRssGrowthMB{256};
+	size_t _maxMapsGrowth{64}; // mappings left after all the threads exited
+	uint64_t _maxRefreshMicrosPerFile{1'000};
+};
+
+size_t countLines(const char* path)
+{
+	std::ifstream file{path};
+	return static_cast<size_t>(std::count(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}, '\n'));
+}
+
+size_t mappings() { return countLines("/proc/self/maps"); }
+
+size_t openFds()
+{
+	return static_cast<size_t>(std::distance(std::filesystem::directory_iterator{"/proc/self/fd"}, std::filesystem::directory_iterator{}));
+}
+
+uint64_t rssBytes()
+{
+	std::ifstream statm{"/proc/self/statm"};
+	uint64_t size{0}, resident{0};
+	statm >> size >> resident;
+	return resident * static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+uint64_t percentile(std::vector<uint64_t> values, size_t p)
+{
+	if (values.empty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+// every instantiation is a call site of its own, they share the id and so the instance counter
+template <size_t site>
+void callSite()
+{
+	ThreadLocalTimeHist(scaleSite, 1000, 100, "scale test");
+	TimeHistBegin(scaleSite);
+	TimeHistEnd(scaleSite);
+}
+
+template <size_t ... sites>
+constexpr auto makeSites(std::index_sequence<sites...>)
+{
+	return std::array<void (*)(), sizeof...(sites)>{&callSite<sites>...};
+}
+
+const auto callSites{makeSites(std::make_index_sequence<maxSites>{})};
+
+std::mutex createMtx;
+std::vector<uint64_t> createMicros;
+std::vector<uint64_t> createCpuMicros;
+
+/*
+	wall time of creating the metrics depends on how many threads share the cpus,
+	the threshold is on their cpu time
+*/
+void shortLivedThread(size_t numSites)
+{
+	std::vector<uint64_t> wall, cpu;
+	for (size_t s = 0; s < numSites; ++s)
+	{
+		const auto begin{std::chrono::steady_clock::now()};
+		const auto beginCpu{profiler::cpuTimeHistogram::threadCpuNanos()};
+		callSites[s]();
+		cpu.push_back((profiler::cpuTimeHistogram::threadCpuNanos() - beginCpu) / 1000);
+		wall.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count()));
+	}
+	for (size_t i = 0; i < 10; ++i)
+	{
+		for (size_t s = 0; s < numSites; ++s)
+			callSites[s]();
+	}
+
+	std::lock_guard<std::mutex> l{createMtx};
+	createMicros.insert(createMicros.end(), wall.begin(), wall.end());
+	createCpuMicros.insert(createCpuMicros.end(), cpu.begin(), cpu.end());
+}
+
+std::vector<std::filesystem::path> scaleFiles()
+{
+	std::vector<std::filesystem::path> files;
+	for (const auto& entry : std::filesystem::directory_iterator{"."})
+	{
+		const auto name{entry.path().filename().string()};
+		if (name.rfind("shmFile_scaleSite_", 0) == 0)
+			files.push_back(entry.path());
+	}
+	return files;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	options opts;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const auto value{std::stoull(argv[i + 1])};
+		if (strcmp(argv[i], "--threads") == 0) opts._threads = value;
+		else if (strcmp(argv[i], "--sites") == 0) opts._sites = std::min<size_t>(value, maxSites);
+		else if (strcmp(argv[i], "--concurrent") == 0) opts._concurrent = std::max<size_t>(value, 1);
+		else if (strcmp(argv[i], "--rate") == 0) opts._rate = value;
+		else if (strcmp(argv[i], "--maxCreateMicros") == 0) opts._maxCreateMicros = value;
+		else if (strcmp(argv[i], "--maxRssGrowthMB") == 0) opts._maxRssGrowthMB = value;
+		else if (strcmp(argv[i], "--maxMapsGrowth") == 0) opts._maxMapsGrowth = value;
+		else if (strcmp(argv[i], "--maxRefreshMicrosPerFile") == 0) opts._maxRefreshMicrosPerFile = value;
+		else
+		{
+			std::cerr << "unknown option: " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	// files of an earlier run would be counted by the reader
+	for (const auto& file : scaleFiles())
+		std::filesystem::remove(file);
+
+	// the registry and the control page are created once, not part of the churn
+	callSites[0]();
+	const auto baseMaps{mappings()};
+	const auto baseFds{openFds()};
+	const auto baseRss{rssBytes()};
+
+	size_t peakMaps{0};
+	const auto churnBegin{std::chrono::steady_clock::now()};
+	std::vector<std::thread> alive;
+	for (size_t t = 0; t < opts._threads; ++t)
+	{
+		if (alive.size() == opts._concurrent)
+		{
+			peakMaps = std::max(peakMaps, mappings());
+			for (auto& thread : alive)
+				thread.join();
+			alive.clear();
+		}
+		if (opts._rate > 0)
+			std::this_thread::sleep_until(churnBegin + std::chrono::microseconds{t * 1'000'000 / opts._rate});
+		alive.emplace_back(shortLivedThread, opts._sites);
+	}
+	for (auto& thread : alive)
+		thread.join();
+	const auto churnMicros{std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - churnBegin).count()};
+
+	const auto endMaps{mappings()};
+	const auto endFds{openFds()};
+	const auto endRss{rssBytes()};
+
+	// a reader maps every file and reads its header
+	const auto files{scaleFiles()};
+	uint64_t diskBytes{0}, numSamples{0};
+	const auto refreshBegin{std::chrono::steady_clock::now()};
+	for (const auto& file : files)
+	{
+		profiler::shmFile<profiler::shmTimeHistHeader, uint64_t> shm{file};
+		numSamples += shm.header()._numSamples;
+		diskBytes += shm.totalSize();
+	}
+	const auto refreshMicros{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - refreshBegin).count())};
+
+	const auto createP50{percentile(createMicros, 50)};
+	const auto createP99{percentile(createMicros, 99)};
+	const auto createCpuP50{percentile(createCpuMicros, 50)};
+	const auto createCpuP99{percentile(createCpuMicros, 99)};
+	const auto rssGrowthMB{endRss > baseRss ? (endRss - baseRss) >> 20 : 0};
+	const auto mapsGrowth{endMaps > baseMaps ? endMaps - baseMaps : 0};
+	const auto refreshPerFile{files.empty() ? 0 : refreshMicros / files.size()};
+
+	std::cout << "threads: " << opts._threads << ", sites: " << opts._sites << ", concurrent: " << opts._concurrent
+		<< ", churn micros: " << churnMicros << std::endl
+		<< "create micros p50: " << createP50 << ", p99: " << createP99
+		<< ", cpu micros p50: " << createCpuP50 << ", p99: " << createCpuP99 << std::endl
+		<< "mappings base: " << baseMaps << ", peak: " << peakMaps << ", end: " << endMaps << std::endl
+		<< "fds base: " << baseFds << ", end: " << endFds << std::endl
+		<< "rss base MB: " << (baseRss >> 20) << ", end MB: " << (endRss >> 20) << std::endl
+		<< "files: " << files.size() << ", disk bytes: " << diskBytes << ", refresh micros: " << refreshMicros
+		<< ", per file: " << refreshPerFile << std::endl;
+
+	for (const auto& file : files)
+		std::filesystem::remove(file);
+
+	int rc{0};
+	auto check = [&rc](bool ok, const char* what){
+		if (!ok)
+		{
+			std::cerr << "threshold exceeded: " << what << std::endl;
+			rc = 1;
+		}
+	};
+	// + 1 - the main thread's instance of the first call site
+	check(files.size() == opts._threads * opts._sites + 1, "a file per thread and call site");
+	check(numSamples == opts._threads * opts._sites * 11 + 1, "samples of all the threads");
+	check(createCpuP99 <= opts._maxCreateMicros, "create latency");
+	check(rssGrowthMB <= opts._maxRssGrowthMB, "rss growth");
+	check(mapsGrowth <= opts._maxMapsGrowth, "mappings left after the threads exited");
+	check(endFds <= baseFds + 1, "fds left after the threads exited");
+	check(refreshPerFile <= opts._maxRefreshMicrosPerFile, "reader refresh");
+	return rc;
+}
@@ -0,0 +1,191 @@
+#include "profilerApi.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// latency like values: mostly around 10 micros with a long tail up to seconds
+std::vector<uint64_t> makeSamples(size_t num, uint64_t seed)
+{
+	std::vector<uint64_t> samples;
+	samples.reserve(num);
+	for (size_t i = 0; i < num; ++i)
+	{
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		const auto uniform{static_cast<double>(seed >> 11) / static_cast<double>(uint64_t{1} << 53)};
+		samples.push_back(static_cast<uint64_t>(10'000 / std::max(uniform, 1e-5)));
+	}
+	return samples;
+}
+
+bool checkQuantiles(const char* what, std::vector<uint64_t> samples, double relativeAccuracy,
+					const std::vector<double>& quantiles, const std::function<double(double)>& quantile)
+{
+	std::sort(samples.begin(), samples.end());
+	bool ok{true};
+	for (const auto q : quantiles)
+	{
+		const auto exact{static_cast<double>(samples[static_cast<size_t>(q * static_cast<double>(samples.size() - 1))])};
+		const auto estimate{quantile(q)};
+		if (std::abs(estimate - exact) > relativeAccuracy * exact + 1e-9)
+		{
+			std::cerr << what << ": quantile " << q << " is " << estimate << " instead of " << exact << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+}
+
+int testAccuracy()
+{
+	ThreadLocalTimeSketch(sketchAccuracy, 0.01, 2048, "accuracy");
+	sketchAccuracy.resetSamples();
+
+	const auto samples{makeSamples(100'000, 1)};
+	for (const auto sample : samples)
+		sketchAccuracy.sample(sample);
+	sketchAccuracy.sample(uint64_t{0});
+
+	auto withZero{samples};
+	withZero.push_back(0);
+
+	const auto& header{sketchAccuracy._shmHist.header()};
+	std::cout << header << std::endl;
+	if (header._numSamples != withZero.size() || header._zeroCount != 1 || header._collapsed != 0
+		|| header._collapsedKey != std::numeric_limits<int64_t>::min())
+	{
+		std::cerr << "unexpected counts" << std::endl;
+		return 1;
+	}
+	const auto ok{checkQuantiles("accuracy", withZero, 0.01, {0, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999, 1},
+								 [&](double q){ return sketchAccuracy.quantile(q); })};
+	return ok ? 0 : 1;
+}
+
+int testCollapsing()
+{
+	// 256 buckets of 1% cover about 160x, the samples span 5 orders of magnitude
+	ThreadLocalTimeSketch(sketchCollapsing, 0.01, 256, "collapsing");
+	sketchCollapsing.resetSamples();
+
+	const auto samples{makeSamples(10'000, 2)};
+	for (const auto sample : samples)
+		sketchCollapsing.sample(sample);
+
+	const auto& header{sketchCollapsing._shmHist.header()};
+	std::cout << header << std::endl;
+	if (header._collapsed == 0 || header._maxKey - header._minKey >= 256 || header._numSamples != samples.size())
+	{
+		std::cerr << "the sketch is not bounded" << std::endl;
+		return 1;
+	}
+	if (header._collapsedKey != header._minKey || sketchCollapsing.quantile(0) > profiler::sketchValue(header._gamma, header._collapsedKey))
+	{
+		std::cerr << "unexpected collapsed key" << std::endl;
+		return 1;
+	}
+	// the top of the distribution keeps its accuracy
+	const auto ok{checkQuantiles("collapsing", samples, 0.01, {0.999, 1},
+								 [&](double q){ return sketchCollapsing.quantile(q); })};
+	return ok ? 0 : 1;
+}
+
+int testTimedRegions()
+{
+	// a time histogram call site switched to the sketch
+	ThreadLocalTimeSketch(sketchRegions, 0.02, 1024, "timed regions");
+	sketchRegions.resetSamples();
+	for (size_t i = 0; i < 10; ++i)
+	{
+		TimeHistBegin(sketchRegions);
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+		TimeHistEnd(sketchRegions);
+	}
+	if (sketchRegions._shmHist.header()._numSamples != 10 || sketchRegions.quantile(0) < 0.98 * 1'000'000)
+	{
+		std::cerr << "unexpected timed regions" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+void recordSamples(const std::vector<uint64_t>& samples)
+{
+	ThreadLocalTimeSketch(sketchThreads, 0.01, 2048, "merged threads");
+	for (const auto sample : samples)
+		sketchThreads.sample(sample);
+}
+
+int testMerge()
+{
+	constexpr size_t numThreads{4};
+	std::vector<uint64_t> all;
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < numThreads; ++t)
+	{
+		const auto samples{makeSamples(20'000, 10 + t)};
+		all.insert(all.end(), samples.begin(), samples.end());
+		threads.emplace_back(recordSamples, samples);
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	// the merge of the thread sketches is the sketch of all the samples
+	profiler::timeSketch single{0.01, 2048, "sketchSingle", 1, "all samples"};
+	single.resetSamples();
+	for (const auto sample : all)
+		single.record(sample);
+
+	profiler::mergedSketch merged;
+	for (size_t t = 1; t <= numThreads; ++t)
+	{
+		profiler::shmFile<profiler::shmSketchHeader, uint64_t> file{"shmFile_sketchThreads_" + std::to_string(t) + ".shm"};
+		merged.merge(file.header(), file.data());
+	}
+
+	const auto& header{single._shmHist.header()};
+	if (merged._numSamples != all.size() || merged._minKey != header._minKey
+		|| merged._counts.size() != static_cast<size_t>(header._maxKey - header._minKey + 1))
+	{
+		std::cerr << "merged sketch has a different shape" << std::endl;
+		return 1;
+	}
+	for (size_t i = 0; i < merged._counts.size(); ++i)
+	{
+		if (merged._counts[i] != single._shmHist.data()[i])
+		{
+			std::cerr << "merged count of key " << merged._minKey + static_cast<int64_t>(i) << " differs" << std::endl;
+			return 1;
+		}
+	}
+	if (!checkQuantiles("merged", all, 0.01, {0.5, 0.9, 0.99, 0.999}, [&](double q){ return merged.quantile(q); }))
+		return 1;
+
+	// buckets of different accuracies don't line up
+	profiler::shmFile<profiler::shmSketchHeader, uint64_t> other{"shmFile_sketchRegions_1.shm"};
+	try
+	{
+		merged.merge(other.header(), other.data());
+		std::cerr << "merged sketches of different accuracies" << std::endl;
+		return 1;
+	}
+	catch (const std::runtime_error&)
+	{
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testAccuracy() + testCollapsing() + testTimedRegions() + testMerge();
+}
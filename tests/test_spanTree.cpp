@@ -0,0 +1,113 @@
+#include "profilerApi.h"
+
+#include <iostream>
+#include <string.h>
+
+ThreadLocalSpanTree(spans, 1000, 100, 8, "span tree test");
+
+void leaf()
+{
+	ScopedSpan(spans, "leaf");
+}
+
+void middle()
+{
+	ScopedSpan(spans, "middle");
+	leaf();
+	leaf();
+}
+
+int testTree()
+{
+	for (size_t i = 0; i < 100; ++i)
+	{
+		ScopedSpan(spans, "top");
+		middle();
+		leaf();
+	}
+
+	// root -> top -> {middle -> leaf, leaf}
+	const auto& header{spans._shmTree.header()};
+	if (header._numNodes != 5 || header._droppedSpans != 0)
+	{
+		std::cerr << "unexpected tree: " << spans << std::endl;
+		return 1;
+	}
+
+	const auto top{spans.node(0)._firstChild};
+	if (strcmp(spans.node(top)._name, "top") != 0 || spans.node(top)._numSamples != 100)
+	{
+		std::cerr << "unexpected top: " << spans << std::endl;
+		return 1;
+	}
+
+	size_t leafs{0}, middles{0};
+	for (auto child = spans.node(top)._firstChild; child != 0; child = spans.node(child)._nextSibling)
+	{
+		const auto& n{spans.node(child)};
+		if (strcmp(n._name, "leaf") == 0 && n._numSamples == 100)
+			++leafs;
+		if (strcmp(n._name, "middle") == 0 && n._numSamples == 100 && spans.node(n._firstChild)._numSamples == 200)
+			++middles;
+	}
+	if (leafs != 1 || middles != 1)
+	{
+		std::cerr << "unexpected children: " << spans << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// histCtl disable: no samples and no new nodes until it's enabled again
+int testDisabled()
+{
+	auto& entry{const_cast<profiler::controlEntry&>(spans._control.entry())};
+	const auto top{spans.node(0)._firstChild};
+	entry.update(false);
+	for (size_t i = 0; i < 10; ++i)
+	{
+		ScopedSpan(spans, "top");
+		middle();
+		ScopedSpan(spans, "disabled");
+	}
+	entry.update(true);
+
+	if (spans._shmTree.header()._numNodes != 5 || spans.node(top)._numSamples != 100 || spans._depth != 0)
+	{
+		std::cerr << "recorded while disabled: " << spans << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testBounded()
+{
+	// a, a/leaf and b fit, b/leaf and the rest are dropped, spans under a dropped parent as well
+	const char* names[]{"a", "b", "c", "d", "e"};
+	for (const auto* name : names)
+	{
+		ScopedSpan(spans, name);
+		leaf();
+	}
+
+	const auto& header{spans._shmTree.header()};
+	if (header._numNodes != header._maxNodes || header._droppedSpans != 7)
+	{
+		std::cerr << "unexpected bounded tree: " << spans << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	if (testTree() != 0)
+		return 1;
+	if (testDisabled() != 0)
+		return 1;
+	if (testBounded() != 0)
+		return 1;
+
+	std::cout << spans << std::endl;
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include "profilerApi.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+int testLinear()
+{
+	// 20 buckets of 0.5 from -5
+	profiler::valueHistogram hist{profiler::linearValues(-5.0, 2.0, 20), "valueLinear", 1, "$", "linear"};
+	const auto& header{hist._shmHist.header()};
+	const auto* data{hist._shmHist.data()};
+
+	hist.sample(-5.0); // first bucket of the range
+	hist.sample(-0.25);
+	hist.sample(0.25);
+	hist.sample(int64_t{-3});
+	hist.sample(-7); // below
+	hist.sample(5.0); // at the top, above
+	hist.sample(std::numeric_limits<double>::quiet_NaN());
+
+	std::cout << header << std::endl;
+	if (data[1] != 1 || data[10] != 1 || data[11] != 1 || data[5] != 1 || data[0] != 1 || data[21] != 2)
+	{
+		std::cerr << "unexpected buckets of the linear layout" << std::endl;
+		return 1;
+	}
+	if (header._underflows != 1 || header._overfows != 2 || header._numSamples != 7 || header._minSample != -7 || header._maxSample != 5)
+	{
+		std::cerr << "unexpected stats of the linear layout" << std::endl;
+		return 1;
+	}
+	// the NaN is in the top bucket, not in the sum
+	if (header._sum != -10)
+	{
+		std::cerr << "unexpected sum of the linear layout " << header._sum << std::endl;
+		return 1;
+	}
+	if (header._layout.lowerBound(10) != -0.5 || header._layout.lowerBound(11) != 0 || !std::isinf(header._layout.lowerBound(0)))
+	{
+		std::cerr << "unexpected lower bounds of the linear layout" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testSymmetric()
+{
+	// from 0.001 to 0.001 * 2^(2 + 10) either way, 4 buckets per power of 2
+	const auto layout{profiler::symmetricLogLinearValues(0.001, 2, 10)};
+	profiler::valueHistogram hist{layout, "valueSymmetric", 1, "seconds", "symmetric"};
+	const auto& header{hist._shmHist.header()};
+	const auto* data{hist._shmHist.data()};
+
+	// mirrored around the zero bucket, every value at or above its bucket's lower bound
+	std::mt19937_64 gen{7};
+	std::uniform_real_distribution<double> dist{-4.0, 4.0};
+	for (size_t i = 0; i < 10'000; ++i)
+	{
+		const auto value{dist(gen)};
+		const auto bucket{layout.index(value)};
+		if (bucket != layout._zeroBucket && layout.index(-value) != 2 * layout._zeroBucket - bucket)
+		{
+			std::cerr << value << " is not mirrored" << std::endl;
+			return 1;
+		}
+		if (layout.lowerBound(bucket) > value || (bucket + 1 < layout._numBuckets && layout.lowerBound(bucket + 1) <= value))
+		{
+			std::cerr << value << " is outside of bucket " << bucket << " [" << layout.lowerBound(bucket) << ", "
+					  << layout.lowerBound(bucket + 1) << ")" << std::endl;
+			return 1;
+		}
+	}
+
+	const std::vector<double> values{0.0, 0.0005, -0.0005, 0.0015, -0.0015, 100.0, -100.0};
+	hist.sampleBatch(values.data(), values.size());
+	const std::vector<int64_t> ints{1, -1};
+	SampleValueHistBatch(hist, ints.data(), ints.size());
+
+	std::cout << header << std::endl;
+	const auto zero{layout._zeroBucket};
+	if (data[zero] != 3 || data[zero + 1] != 1 || data[zero - 1] != 1 || data[0] != 1 || data[layout._numBuckets - 1] != 1)
+	{
+		std::cerr << "unexpected buckets of the symmetric layout" << std::endl;
+		return 1;
+	}
+	if (data[layout.index(1.0)] != 1 || data[layout.index(-1.0)] != 1 || layout.index(1.0) + layout.index(-1.0) != 2 * zero)
+	{
+		std::cerr << "unexpected buckets of the integers" << std::endl;
+		return 1;
+	}
+	if (header._numSamples != 9 || header._underflows != 1 || header._overfows != 1 || header._sum != 0)
+	{
+		std::cerr << "unexpected stats of the symmetric layout" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int testLogLinearBucket()
+{
+	// the same buckets as before the branch free form
+	for (uint64_t subBits = 0; subBits < 5; ++subBits)
+	{
+		const auto subBuckets{uint64_t{1} << subBits};
+		for (uint64_t units = 0; units < 100'000; ++units)
+		{
+			auto expected{units};
+			if (units >= subBuckets)
+			{
+				const auto group{static_cast<uint64_t>(63 - __builtin_clzll(units)) - subBits};
+				expected = subBuckets + group * subBuckets + ((units >> group) - subBuckets);
+			}
+			if (profiler::logLinearBucket(units, subBits) != expected || profiler::logLinearLowerBound(expected, subBits) > units)
+			{
+				std::cerr << "unexpected bucket of " << units << " with " << subBits << " sub bucket bits" << std::endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int testMacro()
+{
+	ThreadLocalValueHist(valuePnl, profiler::linearValues(-1000, 0.01, 20), "$", "P&L deltas");
+	for (int i = -1000; i < 1000; ++i)
+		SampleValueHist(valuePnl, i);
+
+	const auto& header{valuePnl._shmHist.header()};
+	for (uint64_t bucket = 1; bucket <= 20; ++bucket)
+	{
+		if (valuePnl._shmHist.data()[bucket] != 100)
+		{
+			std::cerr << "unexpected count of bucket " << bucket << std::endl;
+			return 1;
+		}
+	}
+	if (header._numSamples != 2000 || header._underflows != 0 || header._overfows != 0 || header._sum != -1000)
+	{
+		std::cerr << "unexpected stats of the macro" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	return testLinear() + testSymmetric() + testLogLinearBucket() + testMacro();
+}